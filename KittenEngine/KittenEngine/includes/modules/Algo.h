@@ -4,6 +4,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
+#include <algorithm>
 
 #include <Eigen/Eigen>
 #include <Eigen/Sparse>
@@ -11,11 +12,159 @@
 #include "Common.h"
 
 namespace Kitten {
-	// Brute force blue noise sampling
-	// Last sample is guaranteed to be included
+	// Blue noise sampling by picking the farthest sample from those already picked.
+	// Distances are updated through a uniform grid and the farthest is found with a lazy max heap.
+	// Last sample is guaranteed to be included. Picked samples are removed from samples.
+	// Ties in distance go to the lowest index in samples.
 	std::vector<vec3> bluenoiseSample(std::vector<vec3>& samples, int N);
 
-	// Uniformly sample a curve as a function from a to b
+	// Parallel Poisson disk sampling. Keeps a subset of samples with no two closer than radius.
+	// Deterministic regardless of thread count. Last sample is guaranteed to be included.
+	std::vector<vec3> poissonDiskSample(const std::vector<vec3>& samples, const float radius);
+
+	/// <summary>
+	/// Arc-length parameterization of a curve f(t) for t in [a, b].
+	/// The curve is adaptively split until each chord is within tol of its two half chords,
+	/// which bounds the error of the total length by tol.
+	/// Queries binary search the cumulative length table and then Newton iterate on the curve.
+	/// f must be thread-safe for the parallel batch queries.
+	/// Func is deduced from the constructor so f is called directly. Func may be a reference type if f outlives the table.
+	/// </summary>
+	template<typename Func = std::function<vec3(float)>>
+	class ArcLengthTable {
+	public:
+		Func f;
+		std::vector<float> ts;		// Parameter of each node
+		std::vector<float> lens;	// Cumulative length at each node
+		std::vector<vec3> pos;		// Curve position at each node
+
+		ArcLengthTable() = default;
+
+		ArcLengthTable(Func f, float a, float b, const float tol = 1e-4f, const int minLevel = 3, const int maxLevel = 20) : f(f) {
+			struct Interval {
+				float t0, t1;
+				vec3 p0, p1;
+				int level;
+			};
+
+			const vec3 pa = this->f(a);
+			ts.push_back(a);
+			lens.push_back(0);
+			pos.push_back(pa);
+			if (b == a) return;
+
+			// Depth first so leaves come out in order
+			const float tolPerLen = tol / abs(b - a);
+			double len = 0;
+			std::vector<Interval> stack;
+			stack.push_back({ a, b, pa, this->f(b), 0 });
+			while (stack.size()) {
+				Interval itv = stack.back();
+				stack.pop_back();
+
+				const float tm = 0.5f * (itv.t0 + itv.t1);
+				const vec3 pm = this->f(tm);
+				const float l0 = length(pm - itv.p0);
+				const float l1 = length(itv.p1 - pm);
+				const float err = l0 + l1 - length(itv.p1 - itv.p0);
+
+				if (itv.level >= maxLevel || (itv.level >= minLevel && err <= tolPerLen * abs(itv.t1 - itv.t0))) {
+					len += l0;
+					ts.push_back(tm);
+					lens.push_back((float)len);
+					pos.push_back(pm);
+
+					len += l1;
+					ts.push_back(itv.t1);
+					lens.push_back((float)len);
+					pos.push_back(itv.p1);
+				}
+				else {
+					stack.push_back({ tm, itv.t1, pm, itv.p1, itv.level + 1 });
+					stack.push_back({ itv.t0, tm, itv.p0, pm, itv.level + 1 });
+				}
+			}
+		}
+
+		float totalLength() const { return lens.empty() ? 0 : lens.back(); }
+
+		// The parameter at arc length s
+		float param(float s) const {
+			const int n = (int)ts.size();
+			if (n < 2 || s <= 0) return ts.empty() ? 0 : ts[0];
+			if (s >= lens.back()) return ts.back();
+
+			// Node interval containing s
+			const int i = std::clamp((int)(std::upper_bound(lens.begin(), lens.end(), s) - lens.begin()) - 1, 0, n - 2);
+			const float segLen = lens[i + 1] - lens[i];
+			if (segLen <= 0) return ts[i];
+
+			// Within a node interval, the curve is flat enough that arc length and chord length are proportional.
+			// Solve |f(t) - f(t_i)| = target with a safeguarded Newton iteration.
+			const vec3 p0 = pos[i];
+			const float target = (s - lens[i]) / segLen * length(pos[i + 1] - p0);
+			// lo and hi bracket the root with g(lo) <= 0 < g(hi)
+			float lo = ts[i], hi = ts[i + 1];
+			const float h = 1e-3f * (hi - lo);
+			float t = glm::mix(lo, hi, (s - lens[i]) / segLen);
+
+			for (int itr = 0; itr < 8; itr++) {
+				const float g = length(f(t) - p0) - target;
+				if (g > 0) hi = t;
+				else lo = t;
+
+				const float dg = (length(f(t + h) - p0) - target - g) / h;
+				float nt = dg > 0 ? t - g / dg : 0.5f * (lo + hi);
+				if (!((nt - lo) * (nt - hi) < 0)) nt = 0.5f * (lo + hi);
+
+				const float dt = nt - t;
+				t = nt;
+				if (abs(dt) <= 1e-6f * abs(ts[i + 1] - ts[i])) break;
+			}
+			return t;
+		}
+
+		// The parameters at each arc length in s. Runs in parallel.
+		std::vector<float> params(const std::vector<float>& s) const {
+			std::vector<float> t(s.size());
+#pragma omp parallel for schedule(dynamic, 64)
+			for (int i = 0; i < (int)s.size(); i++)
+				t[i] = param(s[i]);
+			return t;
+		}
+
+		// numSamples parameters spaced uniformly in arc length, including both ends. Runs in parallel.
+		std::vector<float> uniformSample(const int numSamples) const {
+			std::vector<float> t(std::max(numSamples, 0));
+			if (numSamples <= 0 || ts.empty()) return t;
+			const float len = totalLength();
+
+#pragma omp parallel for schedule(dynamic, 64)
+			for (int i = 0; i < numSamples; i++)
+				if (i == 0) t[i] = ts.front();
+				else if (i == numSamples - 1) t[i] = ts.back();
+				else t[i] = param(len * i / (float)(numSamples - 1));
+			return t;
+		}
+	};
+
+	// Uniformly sample a curve as a function from a to b, with the arc length accurate to tol
+	template<typename Func>
+	std::vector<float> polylineArcLengthSample(Func&& f, float a, float b, const int numSamples, const float tol = 1e-4f) {
+		return ArcLengthTable<Func&>(f, a, b, tol).uniformSample(numSamples);
+	}
+
+	std::vector<float> polylineArcLengthSample(std::function<vec3(float)> f, float a, float b, const int numSamples, const float tol = 1e-4f);
+
+	// Uniformly sample a curve as a function from a to b.
+	// Forwards to polylineArcLengthSample(). numItr and learningRate belonged to the old relaxation scheme and are ignored.
+	template<typename Func>
+	[[deprecated("use polylineArcLengthSample()")]]
+	std::vector<float> polylineUniformSample(Func&& f, float a, float b, const int numSamples, const int numItr = 64, const float learningRate = 1.f) {
+		return polylineArcLengthSample(f, a, b, numSamples);
+	}
+
+	[[deprecated("use polylineArcLengthSample()")]]
 	std::vector<float> polylineUniformSample(std::function<vec3(float)> f, float a, float b, const int numSamples, const int numItr = 64, const float learningRate = 1.f);
 
 	/// <summary>
@@ -27,8 +176,8 @@ namespace Kitten {
 	/// <param name="b">The right hand bound</param>
 	/// <param name="tol">The error tolerance</param>
 	/// <returns>The value of the integral down to the given tolerance</returns>
-	template<typename T, int minLevel, int maxLevel>
-	T adpInt(std::function<T(double)> f, const double a, const double b, const double tol = 0.001) {
+	template<typename T, int minLevel, int maxLevel, typename Func>
+	T adpInt(Func&& f, const double a, const double b, const double tol = 0.001) {
 		// 0 - real, 1 - Eigen, 2 - glm.
 		constexpr int type = (std::is_same<T, float>::value || std::is_same<T, double>::value) ? 0 :
 			((std::is_same <T, Eigen::VectorXf>::value || std::is_same <T, Eigen::VectorXd>::value) ? 1 : 2);
@@ -102,6 +251,11 @@ namespace Kitten {
 		return (b - a) * v[maxLevel - 1];
 	}
 
+	template<typename T, int minLevel, int maxLevel>
+	T adpInt(std::function<T(double)> f, const double a, const double b, const double tol = 0.001) {
+		return adpInt<T, minLevel, maxLevel, std::function<T(double)>&>(f, a, b, tol);
+	}
+
 	/// <summary>
 	/// A constant-memory trapezoidal adaptive romberg integrator. 
 	/// Jerry Hsu 2021
@@ -111,15 +265,392 @@ namespace Kitten {
 	/// <param name="b">The right hand bound</param>
 	/// <param name="tol">The error tolerance</param>
 	/// <returns>The value of the integral down to the given tolerance</returns>
-	template<typename T>
-	T adpInt(std::function<T(double)> f, const double a, const double b, double tol = 0.001) {
+	template<typename T, typename Func>
+	T adpInt(Func&& f, const double a, const double b, double tol = 0.001) {
 		// We allow anywhere from 2^3=8 intervals to 2^13=8192 intervals.
 		// It'll adaptively decide based on the error tolerance
-		return adpInt<T, 3, 13>(f, a, b, tol);
+		return adpInt<T, 3, 13, Func&>(f, a, b, tol);
 	}
 
 	template<typename T>
-	T nDiff(std::function<double(T)> f, T x, const double h = 0.001) {
+	T adpInt(std::function<T(double)> f, const double a, const double b, double tol = 0.001) {
+		return adpInt<T, 3, 13, std::function<T(double)>&>(f, a, b, tol);
+	}
+
+	/// <summary>
+	/// Batched version of adpInt(). The refinement front is walked a level at a time
+	/// and all of its midpoints are evaluated in a single call to f(x, y, n),
+	/// which should fill y[i] = integrand(x[i]) for i in [0, n).
+	/// The batch can be vectorized or threaded by the caller.
+	/// Uses the same error control and per-level sums as adpInt() so the results are identical.
+	/// Memory is proportional to the widest front instead of constant.
+	/// </summary>
+	/// <param name="f">The batched integrand</param>
+	/// <param name="a">The left hand bound</param>
+	/// <param name="b">The right hand bound</param>
+	/// <param name="tol">The error tolerance</param>
+	/// <returns>The value of the integral down to the given tolerance</returns>
+	template<typename T, int minLevel, int maxLevel, typename Func>
+	T adpIntBatch(Func&& f, const double a, const double b, const double tol = 0.001) {
+		// 0 - real, 1 - Eigen, 2 - glm.
+		constexpr int type = (std::is_same<T, float>::value || std::is_same<T, double>::value) ? 0 :
+			((std::is_same <T, Eigen::VectorXf>::value || std::is_same <T, Eigen::VectorXd>::value) ? 1 : 2);
+
+		const double sqrTolPerLen = pow2(tol / (b - a));
+		const int numTop = 1 << minLevel;
+
+		// Sample the ends of the top level intervals
+		std::vector<double> xs(numTop + 1);
+		std::vector<T> ys(numTop + 1);
+		for (int i = 0; i <= numTop; i++)
+			xs[i] = mix(a, b, i / double(numTop));
+		f(xs.data(), ys.data(), numTop + 1);
+
+		// The front. Interval i starts at ats[i] and is 2^-level long with end samples ls[i] and rs[i]
+		std::vector<double> ats(numTop), nats;
+		std::vector<T> ls(numTop), rs(numTop), nls, nrs;
+		for (int i = 0; i < numTop; i++) {
+			ats[i] = i / double(numTop);
+			ls[i] = ys[i];
+			rs[i] = ys[i + 1];
+		}
+
+		T v[maxLevel];
+		if constexpr (type == 0) v[minLevel] = 0;
+		else if constexpr (type == 1) v[minLevel] = T::Zero(ys[0].size());
+		else v[minLevel] = T(0);
+		for (int i = minLevel + 1; i < maxLevel; i++)
+			v[i] = v[minLevel];
+
+		for (int level = minLevel; !ats.empty(); level++) {
+			const double halfLen = 0.5 / double(1 << level);
+			const int n = (int)ats.size();
+
+			// Sample all midpoints at once
+			xs.resize(n);
+			ys.resize(n);
+			for (int i = 0; i < n; i++)
+				xs[i] = mix(a, b, ats[i] + halfLen);
+			f(xs.data(), ys.data(), n);
+
+			nats.clear();
+			nls.clear();
+			nrs.clear();
+			for (int i = 0; i < n; i++) {
+				const T& sampleM = ys[i];
+				const T vh = 0.5 * (ls[i] + rs[i]);
+				const T vhh = 0.25 * (ls[i] + 2. * sampleM + rs[i]);
+				const T err = (vhh - vh) * (1. / 3.);
+
+				double errNormSqr;
+				if constexpr (type == 0) errNormSqr = err * err;
+				else if constexpr (type == 1) errNormSqr = err.squaredNorm();
+				else errNormSqr = dot(err, err);
+
+				if (errNormSqr > sqrTolPerLen && level + 1 < maxLevel) {
+					// Local error has exceeded tolerance. Split it into the next front.
+					nats.push_back(ats[i]);
+					nls.push_back(ls[i]);
+					nrs.push_back(sampleM);
+					nats.push_back(ats[i] + halfLen);
+					nls.push_back(sampleM);
+					nrs.push_back(rs[i]);
+				}
+				else
+					// Fronts are kept in order so this sums in the same order as adpInt()
+					v[level] += vhh + err;
+			}
+
+			ats.swap(nats);
+			ls.swap(nls);
+			rs.swap(nrs);
+		}
+
+		v[maxLevel - 1] /= double(1 << (maxLevel - 1));
+		for (int i = maxLevel - 2; i >= minLevel; i--)
+			v[maxLevel - 1] += v[i] / double(1 << i);
+
+		return (b - a) * v[maxLevel - 1];
+	}
+
+	template<typename T, int minLevel, int maxLevel>
+	T adpIntBatch(std::function<void(const double*, T*, int)> f, const double a, const double b, const double tol = 0.001) {
+		return adpIntBatch<T, minLevel, maxLevel, std::function<void(const double*, T*, int)>&>(f, a, b, tol);
+	}
+
+	// Batched adpInt() with the same 2^3 to 2^13 intervals as the default adpInt()
+	template<typename T, typename Func>
+	T adpIntBatch(Func&& f, const double a, const double b, double tol = 0.001) {
+		return adpIntBatch<T, 3, 13, Func&>(f, a, b, tol);
+	}
+
+	template<typename T>
+	T adpIntBatch(std::function<void(const double*, T*, int)> f, const double a, const double b, double tol = 0.001) {
+		return adpIntBatch<T, 3, 13, std::function<void(const double*, T*, int)>&>(f, a, b, tol);
+	}
+
+	/// <summary>
+	/// Parallel version of adpInt() for expensive integrands. f must be thread-safe.
+	/// The front is first refined breadth first for splitLevels levels with every midpoint evaluated in parallel.
+	/// The remaining subtrees are then handed out dynamically to threads as they free up.
+	/// Accepted values are replayed in interval order afterwards so the result is identical to adpInt().
+	/// Memory is proportional to the number of accepted intervals.
+	/// </summary>
+	/// <param name="f">The integrand</param>
+	/// <param name="a">The left hand bound</param>
+	/// <param name="b">The right hand bound</param>
+	/// <param name="tol">The error tolerance</param>
+	/// <param name="splitLevels">How many levels below minLevel to split before distributing subtrees.
+	/// Raise this when a few top level intervals hold most of the work</param>
+	/// <returns>The value of the integral down to the given tolerance</returns>
+	template<typename T, int minLevel, int maxLevel, typename Func>
+	T adpIntParallel(Func&& f, const double a, const double b, const double tol = 0.001, const int splitLevels = 0) {
+		// 0 - real, 1 - Eigen, 2 - glm.
+		constexpr int type = (std::is_same<T, float>::value || std::is_same<T, double>::value) ? 0 :
+			((std::is_same <T, Eigen::VectorXf>::value || std::is_same <T, Eigen::VectorXd>::value) ? 1 : 2);
+
+		const double sqrTolPerLen = pow2(tol / (b - a));
+		const int numTop = 1 << minLevel;
+
+		// An interval starting at at that is 2^-level long with end samples l and r.
+		// vals holds the accepted (level, value) pairs of its subtree in order.
+		struct Node {
+			double at;
+			int level;
+			T l, r;
+			std::vector<std::pair<int, T>> vals;
+		};
+
+		// Returns the accepted value or false if it should be refined
+		auto accept = [&](const T& l, const T& m, const T& r, const int level, T& val) {
+			const T vh = 0.5 * (l + r);
+			const T vhh = 0.25 * (l + 2. * m + r);
+			const T err = (vhh - vh) * (1. / 3.);
+
+			double errNormSqr;
+			if constexpr (type == 0) errNormSqr = err * err;
+			else if constexpr (type == 1) errNormSqr = err.squaredNorm();
+			else errNormSqr = dot(err, err);
+
+			if (errNormSqr > sqrTolPerLen && level + 1 < maxLevel) return false;
+			val = vhh + err;
+			return true;
+			};
+
+		// Depth first refinement of a subtree in the same order as adpInt()
+		auto refine = [&](auto& self, Node& root, const int level, const double at, const T& l, const T& r) -> void {
+			const double halfLen = 0.5 / double(1 << level);
+			const T m = f(mix(a, b, at + halfLen));
+			T val;
+			if (accept(l, m, r, level, val))
+				root.vals.emplace_back(level, val);
+			else {
+				self(self, root, level + 1, at, l, m);
+				self(self, root, level + 1, at + halfLen, m, r);
+			}
+			};
+
+		// Sample the ends of the top level intervals
+		std::vector<T> ends(numTop + 1);
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i = 0; i <= numTop; i++)
+			ends[i] = f(mix(a, b, i / double(numTop)));
+
+		std::vector<Node> front(numTop), next, nodes;
+		for (int i = 0; i < numTop; i++) {
+			front[i].at = i / double(numTop);
+			front[i].level = minLevel;
+			front[i].l = ends[i];
+			front[i].r = ends[i + 1];
+		}
+
+		// Breadth first splitting with all midpoints of a level sampled in parallel
+		std::vector<T> mids;
+		for (int level = minLevel; level < minLevel + splitLevels && !front.empty(); level++) {
+			const double halfLen = 0.5 / double(1 << level);
+			mids.resize(front.size());
+#pragma omp parallel for schedule(dynamic, 1)
+			for (int i = 0; i < (int)front.size(); i++)
+				mids[i] = f(mix(a, b, front[i].at + halfLen));
+
+			next.clear();
+			for (int i = 0; i < (int)front.size(); i++) {
+				Node& node = front[i];
+				T val;
+				if (accept(node.l, mids[i], node.r, level, val)) {
+					node.vals.emplace_back(level, val);
+					nodes.push_back(std::move(node));
+				}
+				else {
+					next.push_back({ node.at, level + 1, node.l, mids[i] });
+					next.push_back({ node.at + halfLen, level + 1, mids[i], node.r });
+				}
+			}
+			front.swap(next);
+		}
+
+		// Hand out the remaining subtrees
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int i = 0; i < (int)front.size(); i++)
+			refine(refine, front[i], front[i].level, front[i].at, front[i].l, front[i].r);
+
+		for (auto& node : front)
+			nodes.push_back(std::move(node));
+		std::sort(nodes.begin(), nodes.end(), [](const Node& x, const Node& y) { return x.at < y.at; });
+
+		// Replay in interval order so every level is summed exactly like adpInt()
+		T v[maxLevel];
+		if constexpr (type == 0) v[minLevel] = 0;
+		else if constexpr (type == 1) v[minLevel] = T::Zero(ends[0].size());
+		else v[minLevel] = T(0);
+		for (int i = minLevel + 1; i < maxLevel; i++)
+			v[i] = v[minLevel];
+
+		for (auto& node : nodes)
+			for (auto& lv : node.vals)
+				v[lv.first] += lv.second;
+
+		v[maxLevel - 1] /= double(1 << (maxLevel - 1));
+		for (int i = maxLevel - 2; i >= minLevel; i--)
+			v[maxLevel - 1] += v[i] / double(1 << i);
+
+		return (b - a) * v[maxLevel - 1];
+	}
+
+	template<typename T, int minLevel, int maxLevel>
+	T adpIntParallel(std::function<T(double)> f, const double a, const double b, const double tol = 0.001, const int splitLevels = 0) {
+		return adpIntParallel<T, minLevel, maxLevel, std::function<T(double)>&>(f, a, b, tol, splitLevels);
+	}
+
+	// Parallel adpInt() with the same 2^3 to 2^13 intervals as the default adpInt()
+	template<typename T, typename Func>
+	T adpIntParallel(Func&& f, const double a, const double b, double tol = 0.001, const int splitLevels = 0) {
+		return adpIntParallel<T, 3, 13, Func&>(f, a, b, tol, splitLevels);
+	}
+
+	template<typename T>
+	T adpIntParallel(std::function<T(double)> f, const double a, const double b, double tol = 0.001, const int splitLevels = 0) {
+		return adpIntParallel<T, 3, 13, std::function<T(double)>&>(f, a, b, tol, splitLevels);
+	}
+
+	namespace detail {
+		// The squared norm of a real, Eigen or glm value
+		template<typename T>
+		double normSqr(const T& v) {
+			if constexpr (std::is_arithmetic<T>::value) return (double)v * v;
+			else if constexpr (std::is_base_of<Eigen::MatrixBase<T>, T>::value) return v.squaredNorm();
+			else return dot(v, v);
+		}
+	}
+
+	/// <summary>
+	/// A single 15 point Gauss-Kronrod rule over [a, b].
+	/// </summary>
+	/// <param name="f">The integrand</param>
+	/// <param name="a">The left hand bound</param>
+	/// <param name="b">The right hand bound</param>
+	/// <param name="err">The difference to the embedded 7 point Gauss rule</param>
+	/// <returns>The Kronrod estimate</returns>
+	template<typename T, typename Func>
+	T gaussKronrod15(Func&& f, const double a, const double b, T& err) {
+		static constexpr double xgk[8] = {
+			0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+			0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+			0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+			0.207784955007898467600689403773245, 0.000000000000000000000000000000000 };
+		static constexpr double wgk[8] = {
+			0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+			0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+			0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+			0.204432940075298892414161999234649, 0.209482141084727828012999174891714 };
+		// Gauss weights of the odd Kronrod nodes
+		static constexpr double wg[4] = {
+			0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+			0.381830050505118944950369775488975, 0.417959183673469387755102040816327 };
+
+		const double c = 0.5 * (a + b);
+		const double h = 0.5 * (b - a);
+
+		const T fc = f(c);
+		T k = wgk[7] * fc;
+		T g = wg[3] * fc;
+		for (int i = 0; i < 7; i++) {
+			const T fs = f(c - h * xgk[i]) + f(c + h * xgk[i]);
+			k += wgk[i] * fs;
+			if (i & 1) g += wg[i / 2] * fs;
+		}
+
+		err = h * (k - g);
+		return h * k;
+	}
+
+	/// <summary>
+	/// A globally adaptive G7-K15 integrator. The interval with the largest error is bisected
+	/// until the summed error estimate drops below tol.
+	/// Much cheaper than adpInt() for smooth integrands.
+	/// </summary>
+	/// <param name="f">The integrand</param>
+	/// <param name="a">The left hand bound</param>
+	/// <param name="b">The right hand bound</param>
+	/// <param name="tol">The error tolerance</param>
+	/// <param name="maxIntervals">The most intervals to split into</param>
+	/// <param name="errEst">Optional output for the final error estimate</param>
+	/// <returns>The value of the integral down to the given tolerance</returns>
+	template<typename T, typename Func>
+	T adpIntGK(Func&& f, const double a, const double b, const double tol = 1e-8, const int maxIntervals = 1024, double* errEst = nullptr) {
+		struct Interval {
+			double a, b, err;
+			T val;
+		};
+		auto cmp = [](const Interval& x, const Interval& y) { return x.err < y.err; };
+
+		// Max heap on error
+		std::vector<Interval> heap;
+		heap.reserve(maxIntervals + 1);
+		T err;
+		T val = gaussKronrod15<T>(f, a, b, err);
+		heap.push_back({ a, b, sqrt(detail::normSqr(err)), val });
+		double totalErr = heap[0].err;
+
+		while (totalErr > tol && (int)heap.size() < maxIntervals) {
+			std::pop_heap(heap.begin(), heap.end(), cmp);
+			const Interval worst = heap.back();
+			heap.pop_back();
+
+			const double m = 0.5 * (worst.a + worst.b);
+			Interval l = { worst.a, m, 0, gaussKronrod15<T>(f, worst.a, m, err) };
+			l.err = sqrt(detail::normSqr(err));
+			Interval r = { m, worst.b, 0, gaussKronrod15<T>(f, m, worst.b, err) };
+			r.err = sqrt(detail::normSqr(err));
+
+			totalErr += l.err + r.err - worst.err;
+			heap.push_back(l);
+			std::push_heap(heap.begin(), heap.end(), cmp);
+			heap.push_back(r);
+			std::push_heap(heap.begin(), heap.end(), cmp);
+		}
+
+		// Sum left to right so the result does not depend on heap order
+		std::sort(heap.begin(), heap.end(), [](const Interval& x, const Interval& y) { return x.a < y.a; });
+		val = heap[0].val;
+		totalErr = heap[0].err;
+		for (size_t i = 1; i < heap.size(); i++) {
+			val += heap[i].val;
+			totalErr += heap[i].err;
+		}
+
+		if (errEst) *errEst = totalErr;
+		return val;
+	}
+
+	template<typename T>
+	T adpIntGK(std::function<T(double)> f, const double a, const double b, const double tol = 1e-8, const int maxIntervals = 1024, double* errEst = nullptr) {
+		return adpIntGK<T, std::function<T(double)>&>(f, a, b, tol, maxIntervals, errEst);
+	}
+
+	// Numerical gradient of the scalar function f at x
+	template<typename T, typename Func>
+	T nDiff(Func&& f, T x, const double h = 0.001) {
 		if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value)
 			return (T)((f(x - 2 * h) - 8 * f(x - h) + 8 * f(x + h) - f(x + 2 * h)) / (12 * h));
 		else {
@@ -153,18 +684,25 @@ namespace Kitten {
 	}
 
 	template<typename T>
-	T nDiff(std::function<T(double)> f, double x, const double h = 0.001) {
-		if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value)
-			return (T)((f(x - 2 * h) - 8 * f(x - h) + 8 * f(x + h) - f(x + 2 * h)) / (12 * h));
-		else {
-			T g(0);
-			int s = T::length();
-			g += f(x - 2 * h);
-			g -= 8.f * f(x - h);
-			g += 8.f * f(x + h);
-			g -= f(x + 2 * h);
-			return g * (float)(1 / (12 * h));
-		}
+	T nDiff(std::function<double(T)> f, T x, const double h = 0.001) {
+		return nDiff<T, std::function<double(T)>&>(f, x, h);
+	}
+
+	// Numerical derivative of the vector valued function f at x.
+	// Scalar valued functions are handled by the overload above.
+	template<typename T, typename Func>
+	std::enable_if_t<!std::is_arithmetic<T>::value, T> nDiff(Func&& f, double x, const double h = 0.001) {
+		T g(0);
+		g += f(x - 2 * h);
+		g -= 8.f * f(x - h);
+		g += 8.f * f(x + h);
+		g -= f(x + 2 * h);
+		return g * (float)(1 / (12 * h));
+	}
+
+	template<typename T>
+	std::enable_if_t<!std::is_arithmetic<T>::value, T> nDiff(std::function<T(double)> f, double x, const double h = 0.001) {
+		return nDiff<T, std::function<T(double)>&>(f, x, h);
 	}
 
 	/// <summary>
@@ -175,7 +713,8 @@ namespace Kitten {
 	/// <param name="b"></param>
 	/// <param name="tol"></param>
 	/// <returns></returns>
-	inline dvec2 goldenIntMinSearch(std::function<double(double)> f, double a, double b, double tol = 0.001) {
+	template<typename Func>
+	inline dvec2 goldenIntMinSearch(Func&& f, double a, double b, double tol = 0.001) {
 		const double invPhi = (sqrt(5) - 1) * 0.5;
 		const double invPhi2 = pow2(invPhi);
 
@@ -209,6 +748,10 @@ namespace Kitten {
 		return dvec2((yc < yd) ? (a + d) * 0.5 : (c + b) * 0.5, glm::min(yc, yd));
 	}
 
+	inline dvec2 goldenIntMinSearch(std::function<double(double)> f, double a, double b, double tol = 0.001) {
+		return goldenIntMinSearch<std::function<double(double)>&>(f, a, b, tol);
+	}
+
 	/// <summary>
 	/// Finds a local min of an arbitrary function
 	/// </summary>
@@ -219,6 +762,88 @@ namespace Kitten {
 	/// <param name="tol"></param>
 	/// <param name="m"></param>
 	/// <returns></returns>
+	template<typename FFunc, typename GFunc>
+	Eigen::VectorXf lbfgsMin(int numVars, FFunc&& f, GFunc&& g,
+		Eigen::VectorXf& guess, const float tol = 1e-6, const int m = 6) {
+		using namespace Eigen;
+
+		MatrixXf s(numVars, m);
+		MatrixXf y(numVars, m);
+		VectorXf rho(m);
+		VectorXf a(m);
+
+		int buffSize = 0;
+		int buffInd = 0;
+
+		VectorXf lastX = guess;
+		VectorXf lastGv = g(guess);
+		VectorXf x = guess - 0.001f * lastGv;
+		float fv = f(x);
+		VectorXf gv;
+		VectorXf z;
+		int itr = 0;
+		while (true) {
+			itr++;
+
+			const int ind = buffInd % m;
+
+			// Find descent direction with lbfgs
+
+			gv = g(x);
+			float k = (gv - lastGv).dot(x - lastX);
+			if (k <= 0) {
+				x -= 0.001f * gv;
+				if (gv.norm() < tol) break;
+				continue;
+			}
+
+			s.col(ind) = x - lastX;
+			y.col(ind) = gv - lastGv;
+			rho[ind] = 1 / k;
+
+			lastX = x;
+			lastGv = gv;
+			z = gv;
+			buffSize = std::min(m, buffSize + 1);
+
+			for (int i = 0; i < buffSize; i++) {
+				const int oi = (buffInd + m - i) % m;
+				a[oi] = rho[oi] * z.dot(s.col(oi));
+				z -= a[oi] * y.col(oi);
+			}
+
+			float Y = y.col(ind).dot(y.col(ind));
+			if (Y != 0) {
+				Y = s.col(ind).dot(y.col(ind)) / Y;
+				z *= Y;
+			}
+			for (int i = 0; i < buffSize; i++) {
+				const int oi = (buffInd + m + i - buffSize + 1) % m;
+				z += s.col(oi) * (a[oi] - rho[oi] * y.col(oi).dot(z));
+			}
+
+			z *= -1;
+			// Perform backtracking line search
+			float t = 0.5f * gv.dot(z);
+			float a = 1.f;
+			float v = f(x);
+			while (f(x + a * z) > v + a * t)
+				a *= 0.5f;
+
+			// Update guess
+			x += a * z;
+			float newFv = f(x);
+			float diff = newFv - fv;
+			fv = newFv;
+
+			buffInd++;
+
+			if (gv.norm() < tol && abs(diff) < tol) break;
+		}
+		// printf("ITR: %d\n", itr);
+		return x;
+	}
+
 	Eigen::VectorXf lbfgsMin(int numVars, std::function<float(Eigen::VectorXf)> f,
 		std::function<Eigen::VectorXf(Eigen::VectorXf)> g,
 		Eigen::VectorXf& guess, const float tol = 1e-6, const int m = 6);
@@ -238,6 +863,104 @@ namespace Kitten {
 		const int itrLim = -1
 	);
 
+	/// <summary>
+	/// Matrix-free version of cg(). Solves arg min(0.5 x^T A x - b^T x)
+	/// Stops early if a direction of non-positive curvature is found (truncated CG).
+	/// </summary>
+	/// <param name="A">computes Ax given x</param>
+	/// <param name="invDiag">the inverse diagonal of A used as the preconditioner</param>
+	/// <param name="b">the vector in Ax = b</param>
+	/// <param name="tol">tolerance relative to the initial residual</param>
+	/// <param name="itrLim">iteration limit. -1 for infinity</param>
+	/// <param name="numItr">optional output for the number of iterations taken</param>
+	/// <returns></returns>
+	Eigen::VectorXd cg(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> A,
+		Eigen::VectorXd& invDiag,
+		Eigen::VectorXd& b,
+		const double tol = 1e-13,
+		const int itrLim = -1,
+		int* numItr = nullptr
+	);
+
+	// Settings for newtonMin()
+	struct NewtonParams {
+		double tol = 1e-8;				// Stops once the (projected) gradient norm is below tol
+		int itrLim = 100;				// Newton iteration limit
+		int cgItrLim = -1;				// CG iteration limit per Newton step. -1 for twice the number of variables
+
+		// Eisenstat-Walker forcing terms (choice 2)
+		double etaMax = 0.5;
+		double etaMin = 1e-10;
+		double ewGamma = 0.9;
+		double ewAlpha = 2;
+
+		// Backtracking line search
+		double armijo = 1e-4;
+		double backtrack = 0.5;
+		int lineSearchLim = 40;
+
+		// Optional lower bound on x. Must outlive the call.
+		Eigen::VectorXd* lower = nullptr;
+		bool verbose = false;
+	};
+
+	// Instrumentation returned by newtonMin()
+	struct NewtonStats {
+		int itr = 0;
+		int cgItr = 0;
+		int numFEvals = 0;
+		int numGEvals = 0;
+		int numHEvals = 0;
+		double f = 0;
+		double gradNorm = 0;
+		bool converged = false;
+		std::vector<double> energy;		// Energy after each Newton iteration
+	};
+
+	/// <summary>
+	/// Finds a local min with a (projected) truncated Newton-CG method.
+	/// Each step is solved with cg() (or bccg() if bounded) to an Eisenstat-Walker adaptive tolerance
+	/// followed by a backtracking line search.
+	/// </summary>
+	/// <param name="f">the energy</param>
+	/// <param name="g">the gradient of f</param>
+	/// <param name="H">the assembled hessian of f</param>
+	/// <param name="guess">the initial guess</param>
+	/// <param name="params">solver settings</param>
+	/// <param name="stats">optional output instrumentation</param>
+	/// <returns>the minimizer</returns>
+	Eigen::VectorXd newtonMin(
+		std::function<double(const Eigen::VectorXd&)> f,
+		std::function<Eigen::VectorXd(const Eigen::VectorXd&)> g,
+		std::function<Eigen::SparseMatrix<double, Eigen::RowMajor>(const Eigen::VectorXd&)> H,
+		const Eigen::VectorXd& guess,
+		const NewtonParams& params = NewtonParams(),
+		NewtonStats* stats = nullptr
+	);
+
+	/// <summary>
+	/// Matrix-free version of newtonMin().
+	/// Bounds are handled through a projected Newton active set instead of bccg().
+	/// </summary>
+	/// <param name="f">the energy</param>
+	/// <param name="g">the gradient of f</param>
+	/// <param name="Hv">computes Hv = H(x) v given (x, v)</param>
+	/// <param name="diagH">returns the diagonal of H(x) for preconditioning. Can be null</param>
+	/// <param name="guess">the initial guess</param>
+	/// <param name="params">solver settings</param>
+	/// <param name="stats">optional output instrumentation</param>
+	/// <returns>the minimizer</returns>
+	Eigen::VectorXd newtonMin(
+		std::function<double(const Eigen::VectorXd&)> f,
+		std::function<Eigen::VectorXd(const Eigen::VectorXd&)> g,
+		std::function<void(const Eigen::VectorXd&, const Eigen::VectorXd&, Eigen::VectorXd&)> Hv,
+		std::function<Eigen::VectorXd(const Eigen::VectorXd&)> diagH,
+		const Eigen::VectorXd& guess,
+		const NewtonParams& params = NewtonParams(),
+		NewtonStats* stats = nullptr
+	);
+
 	/// <summary>
 	/// Solves arg min(0.5 x^T A x - b^T x) s.t. lower <= x
 	/// An implementation of the Bound Constrained Conjugate Gradients method
@@ -248,14 +971,18 @@ namespace Kitten {
 	/// <param name="b">the vector in Ax = b</param>
 	/// <param name="lower">the lower bound for x</param>
 	/// <param name="tol">tolerance</param>
-	/// <param name="itrLim">iteration limit. -1 for infinity</param>
+	/// <param name="itrLim">iteration limit shared by the warm start and the bounded iterations. -1 for infinity</param>
+	/// <param name="numItr">optional output for the number of iterations taken, including the warm start</param>
+	/// <param name="warmStart">start from an unconstrained Eigen CG solve capped at itrLim. Otherwise start from zero.</param>
 	/// <returns></returns>
 	Eigen::VectorXd bccg(
 		Eigen::SparseMatrix<double, Eigen::RowMajor>& A,
 		Eigen::VectorXd& b,
 		Eigen::VectorXd& lower,
 		const double tol = 1e-13,
-		const int itrLim = -1
+		const int itrLim = -1,
+		int* numItr = nullptr,
+		const bool warmStart = true
 	);
 
 
@@ -453,4 +1180,189 @@ namespace Kitten {
 
 		return good;
 	}
+
+	/// <summary>
+	/// Greedy Curtis-Powell-Reid coloring of the columns of a jacobian sparsity pattern.
+	/// Columns sharing a color have no rows in common so they can be perturbed together.
+	/// </summary>
+	/// <param name="pattern">the sparsity pattern. Rows are residuals and columns are variables</param>
+	/// <param name="colors">the output color of each column</param>
+	/// <returns>the number of colors</returns>
+	int colorJacobian(const Eigen::SparseMatrix<double, Eigen::RowMajor>& pattern, std::vector<int>& colors);
+
+	/// <summary>
+	/// Computes the jacobian of f with the same 4 point stencil as nDiff().
+	/// Stencil points are evaluated in parallel so f must be thread-safe.
+	/// </summary>
+	/// <param name="f">computes the residual r(x) given (x, r)</param>
+	/// <param name="x">the point to differentiate at</param>
+	/// <param name="numResiduals">the size of r</param>
+	/// <param name="h">the step size</param>
+	/// <returns>the dense jacobian</returns>
+	Eigen::MatrixXd nJacobian(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> f,
+		const Eigen::VectorXd& x,
+		const int numResiduals,
+		const double h = 1e-3
+	);
+
+	/// <summary>
+	/// Sparse version of nJacobian(). Only entries within the pattern are computed
+	/// and columns are colored so only 4 * colors evaluations of f are needed.
+	/// Stencil points are evaluated in parallel so f must be thread-safe.
+	/// </summary>
+	/// <param name="f">computes the residual r(x) given (x, r)</param>
+	/// <param name="x">the point to differentiate at</param>
+	/// <param name="pattern">the sparsity pattern of the jacobian</param>
+	/// <param name="h">the step size</param>
+	/// <returns>the sparse jacobian with the same structure as pattern</returns>
+	Eigen::SparseMatrix<double, Eigen::RowMajor> nJacobian(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> f,
+		const Eigen::VectorXd& x,
+		const Eigen::SparseMatrix<double, Eigen::RowMajor>& pattern,
+		const double h = 1e-3
+	);
+
+	/// <summary>
+	/// Checks a dense jacobian J at x against nJacobian().
+	/// Reports per-entry relative errors in the same style as checkJacobian&lt;N, M&gt;().
+	/// </summary>
+	bool checkJacobian(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> f,
+		const Eigen::MatrixXd& J,
+		const Eigen::VectorXd& x,
+		const double tol = 1e-5,
+		const double h = 1e-3
+	);
+
+	/// <summary>
+	/// Checks a sparse jacobian J at x against the colored nJacobian().
+	/// Reports per-entry relative errors in the same style as checkJacobian&lt;N, M&gt;().
+	/// </summary>
+	/// <param name="pattern">the pattern to differentiate with. Defaults to the structure of J. 
+	/// Entries missing from J but within the pattern are checked against 0</param>
+	bool checkJacobian(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> f,
+		const Eigen::SparseMatrix<double, Eigen::RowMajor>& J,
+		const Eigen::VectorXd& x,
+		const double tol = 1e-5,
+		const double h = 1e-3,
+		const Eigen::SparseMatrix<double, Eigen::RowMajor>* pattern = nullptr
+	);
+
+	/// <summary>
+	/// Randomized gradient check for problems too large for checkJacobian().
+	/// Compares grad . v against central differences of f along K random unit directions.
+	/// Each directional derivative is Richardson extrapolated over step sizes h, h/2, ..., h/2^(levels-1).
+	/// All 2 * K * levels evaluations are done in parallel so f must be thread-safe.
+	/// Reports per-direction errors in the same style as checkJacobian().
+	/// </summary>
+	/// <param name="f">the energy</param>
+	/// <param name="grad">the gradient of f at x to check</param>
+	/// <param name="x">the point to check at</param>
+	/// <param name="K">the number of random directions</param>
+	/// <param name="tol">the relative error tolerance</param>
+	/// <param name="h">the largest step size</param>
+	/// <param name="levels">the number of step sizes used for extrapolation</param>
+	/// <param name="maxErr">optional output for the worst-case relative error</param>
+	/// <returns>whether every direction is within tolerance</returns>
+	bool checkGradient(
+		std::function<double(const Eigen::VectorXd&)> f,
+		const Eigen::VectorXd& grad,
+		const Eigen::VectorXd& x,
+		const int K = 16,
+		const double tol = 1e-5,
+		const double h = 1e-3,
+		const int levels = 3,
+		double* maxErr = nullptr
+	);
+
+	// Settings for lmMin()
+	struct LMParams {
+		double tol = 1e-10;				// Stops once the gradient J^T r infinity norm is below tol
+		double stepTol = 1e-12;			// Stops once the step is below stepTol relative to x
+		int itrLim = 100;				// Outer iteration limit. Rejected steps count as iterations
+		int cgItrLim = -1;				// CG iteration limit per step. -1 for twice the number of variables
+		double cgTol = 1e-6;			// CG tolerance relative to the initial residual
+
+		// Initial damping relative to the largest diagonal entry of J^T J.
+		// Afterwards it is adapted with Nielsen's gain ratio update.
+		double damping = 1e-3;
+
+		// Finite difference step used when no jacobian is given
+		double h = 1e-4;
+		bool verbose = false;
+	};
+
+	// Instrumentation returned by lmMin()
+	struct LMStats {
+		int itr = 0;
+		int cgItr = 0;
+		int numREvals = 0;				// Residual evaluations outside of finite differencing
+		int numJEvals = 0;
+		int numRejected = 0;
+		double cost = 0;				// 0.5 |r|^2
+		double gradNorm = 0;
+		double damping = 0;				// The final absolute damping
+		bool converged = false;
+		std::vector<double> costs;		// Cost after each accepted step
+	};
+
+	/// <summary>
+	/// Minimizes 0.5 |r(x)|^2 with a sparse Levenberg-Marquardt method.
+	/// Each damped normal equation (J^T J + mu I) d = -J^T r is solved matrix-free with cg()
+	/// so J^T J is never assembled. mu -> 0 recovers Gauss-Newton.
+	/// </summary>
+	/// <param name="r">computes the residual r(x) given (x, r)</param>
+	/// <param name="J">returns the jacobian of r at x</param>
+	/// <param name="guess">the initial guess</param>
+	/// <param name="params">solver settings</param>
+	/// <param name="stats">optional output instrumentation</param>
+	/// <returns>the minimizer</returns>
+	Eigen::VectorXd lmMin(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> r,
+		std::function<Eigen::SparseMatrix<double, Eigen::RowMajor>(const Eigen::VectorXd&)> J,
+		const Eigen::VectorXd& guess,
+		const LMParams& params = LMParams(),
+		LMStats* stats = nullptr
+	);
+
+	/// <summary>
+	/// Residual only version of lmMin(). The jacobian is computed with the colored nJacobian()
+	/// so residuals are evaluated in parallel and r must be thread-safe.
+	/// </summary>
+	/// <param name="r">computes the residual r(x) given (x, r)</param>
+	/// <param name="pattern">the sparsity pattern of the jacobian. Rows are residuals and columns are variables</param>
+	/// <param name="guess">the initial guess</param>
+	/// <param name="params">solver settings</param>
+	/// <param name="stats">optional output instrumentation</param>
+	/// <returns>the minimizer</returns>
+	Eigen::VectorXd lmMin(
+		std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> r,
+		const Eigen::SparseMatrix<double, Eigen::RowMajor>& pattern,
+		const Eigen::VectorXd& guess,
+		const LMParams& params = LMParams(),
+		LMStats* stats = nullptr
+	);
+
+	/// <summary>
+	/// Wraps independent scalar residuals r_i(x) into a residual function evaluated in parallel.
+	/// Inside nJacobian() the outer stencil loop is already parallel so this only helps single evaluations.
+	/// </summary>
+	/// <param name="ri">computes residual i given (x, i). Must be thread-safe</param>
+	/// <param name="numResiduals">the number of residuals</param>
+	/// <returns>the residual function</returns>
+	inline std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> parallelResiduals(
+		std::function<double(const Eigen::VectorXd&, int)> ri, const int numResiduals) {
+		return [ri, numResiduals](const Eigen::VectorXd& x, Eigen::VectorXd& r) {
+			r.resize(numResiduals);
+#pragma omp parallel for schedule(static, 64)
+			for (int i = 0; i < numResiduals; i++)
+				r[i] = ri(x, i);
+			};
+	}
+
+	// Microbenchmark comparing the templated callable paths against the std::function entry points.
+	// Covers adpInt(), goldenIntMinSearch(), nDiff(), lbfgsMin() and the function_ref optimizers in opt/.
+	void benchCallables(int itr = 20000);
 }
\ No newline at end of file
@@ -0,0 +1,264 @@
+#pragma once
+// Structure of arrays storage for many bounds with batched query kernels.
+
+#include <vector>
+#include <algorithm>
+#include <immintrin.h>
+#include "Bound.h"
+
+namespace Kitten {
+	class Mesh;
+
+	/// <summary>
+	/// An array of Bound<dim> stored as one array per min and max component.
+	/// Queries test one query against 8 bounds at a time with AVX and return the indices of the hits in ascending order.
+	/// Builds and queries run in parallel.
+	/// </summary>
+	template<int dim = 3>
+	class BoundArray {
+	public:
+		typedef Bound<dim, float> bound_type;
+		typedef vec<dim, float, defaultp> vec_type;
+		static constexpr int WIDTH = 8;
+
+	private:
+		size_t count = 0;
+		// Padded to a multiple of WIDTH with empty bounds
+		std::vector<float> lo[dim];
+		std::vector<float> hi[dim];
+
+		// Calls mask(i) for every group of WIDTH bounds. Bit l of its result selects bound i + l.
+		template<typename F>
+		void select(const F& mask, std::vector<int>& out) const {
+			constexpr size_t blockSize = 4096;
+			const size_t n = lo[0].size();
+			const int numBlocks = (int)((n + blockSize - 1) / blockSize);
+			std::vector<int> counts(numBlocks);
+			out.resize(n);
+			int* o = out.data();
+
+			// Each block compacts its hits in place at its own start
+#pragma omp parallel for schedule(static, 1)
+			for (int b = 0; b < numBlocks; b++) {
+				const size_t start = b * blockSize;
+				const size_t end = std::min(n, start + blockSize);
+				int* __restrict ob = o + start;
+				int cnt = 0;
+				for (size_t i = start; i < end; i += WIDTH) {
+					int m = mask(i);
+					if (i + WIDTH > count) m &= (1 << (count - i)) - 1;
+					if (!m) continue;
+					for (int l = 0; l < WIDTH; l++) {
+						ob[cnt] = (int)(i + l);
+						cnt += (m >> l) & 1;
+					}
+				}
+				counts[b] = cnt;
+			}
+
+			size_t total = 0;
+			for (int b = 0; b < numBlocks; b++) {
+				const size_t start = b * blockSize;
+				if (total != start)
+					std::copy(o + start, o + start + counts[b], o + total);
+				total += counts[b];
+			}
+			out.resize(total);
+		}
+
+	public:
+		BoundArray() {}
+
+		BoundArray(const size_t n) {
+			resize(n);
+		}
+
+		BoundArray(const std::vector<bound_type>& bounds) {
+			build(bounds.size(), [&](size_t i) { return bounds[i]; });
+		}
+
+		// Resizes the array. New bounds are empty.
+		void resize(const size_t n) {
+			count = n;
+			const size_t padded = (n + WIDTH - 1) / WIDTH * WIDTH;
+			for (int d = 0; d < dim; d++) {
+				lo[d].resize(padded, INFINITY);
+				hi[d].resize(padded, -INFINITY);
+			}
+		}
+
+		// Resizes to n and sets bound i to f(i) in parallel
+		template<typename F>
+		void build(const size_t n, const F& f) {
+			resize(n);
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)n; i++)
+				set(i, f(i));
+		}
+
+		size_t size() const { return count; }
+
+		void set(const size_t i, const bound_type& b) {
+			for (int d = 0; d < dim; d++) {
+				lo[d][i] = b.min[d];
+				hi[d][i] = b.max[d];
+			}
+		}
+
+		bound_type operator[](const size_t i) const {
+			bound_type b;
+			for (int d = 0; d < dim; d++) {
+				b.min[d] = lo[d][i];
+				b.max[d] = hi[d][i];
+			}
+			return b;
+		}
+
+		// The contiguous arrays of min and max along axis d
+		const float* minData(const int d) const { return lo[d].data(); }
+		const float* maxData(const int d) const { return hi[d].data(); }
+
+		// The bound of all bounds
+		bound_type bounds() const {
+			bound_type b;
+			for (int d = 0; d < dim; d++) {
+				if (!count) break;
+				b.min[d] = *std::min_element(lo[d].begin(), lo[d].end());
+				b.max[d] = *std::max_element(hi[d].begin(), hi[d].end());
+			}
+			return b;
+		}
+
+		// Indices of bounds b with b.intersects(q)
+		void overlapping(const bound_type& q, std::vector<int>& out) const {
+#ifdef __AVX__
+			__m256 qMin[dim], qMax[dim];
+			for (int d = 0; d < dim; d++) {
+				qMin[d] = _mm256_set1_ps(q.min[d]);
+				qMax[d] = _mm256_set1_ps(q.max[d]);
+			}
+			select([&](size_t i) {
+				__m256 m = _mm256_and_ps(
+					_mm256_cmp_ps(_mm256_loadu_ps(&hi[0][i]), qMin[0], _CMP_GT_OQ),
+					_mm256_cmp_ps(_mm256_loadu_ps(&lo[0][i]), qMax[0], _CMP_LT_OQ));
+				for (int d = 1; d < dim; d++) {
+					m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(&hi[d][i]), qMin[d], _CMP_GT_OQ));
+					m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(&lo[d][i]), qMax[d], _CMP_LT_OQ));
+				}
+				return _mm256_movemask_ps(m);
+				}, out);
+#else
+			select([&](size_t i) {
+				int m = 0;
+				for (int l = 0; l < WIDTH; l++)
+					m |= (int)(*this)[i + l].intersects(q) << l;
+				return m;
+				}, out);
+#endif
+		}
+
+		// Indices of bounds b with q.contains(b)
+		void containedIn(const bound_type& q, std::vector<int>& out) const {
+#ifdef __AVX__
+			__m256 qMin[dim], qMax[dim];
+			for (int d = 0; d < dim; d++) {
+				qMin[d] = _mm256_set1_ps(q.min[d]);
+				qMax[d] = _mm256_set1_ps(q.max[d]);
+			}
+			select([&](size_t i) {
+				__m256 m = _mm256_and_ps(
+					_mm256_cmp_ps(_mm256_loadu_ps(&lo[0][i]), qMin[0], _CMP_GE_OQ),
+					_mm256_cmp_ps(_mm256_loadu_ps(&hi[0][i]), qMax[0], _CMP_LE_OQ));
+				for (int d = 1; d < dim; d++) {
+					m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(&lo[d][i]), qMin[d], _CMP_GE_OQ));
+					m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(&hi[d][i]), qMax[d], _CMP_LE_OQ));
+				}
+				return _mm256_movemask_ps(m);
+				}, out);
+#else
+			select([&](size_t i) {
+				int m = 0;
+				for (int l = 0; l < WIDTH; l++)
+					m |= (int)q.contains((*this)[i + l]) << l;
+				return m;
+				}, out);
+#endif
+		}
+
+		// Indices of bounds b with b.contains(p)
+		void containing(const vec_type& p, std::vector<int>& out) const {
+#ifdef __AVX__
+			__m256 pv[dim];
+			for (int d = 0; d < dim; d++)
+				pv[d] = _mm256_set1_ps(p[d]);
+			select([&](size_t i) {
+				__m256 m = _mm256_and_ps(
+					_mm256_cmp_ps(_mm256_loadu_ps(&lo[0][i]), pv[0], _CMP_LE_OQ),
+					_mm256_cmp_ps(_mm256_loadu_ps(&hi[0][i]), pv[0], _CMP_GE_OQ));
+				for (int d = 1; d < dim; d++) {
+					m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(&lo[d][i]), pv[d], _CMP_LE_OQ));
+					m = _mm256_and_ps(m, _mm256_cmp_ps(_mm256_loadu_ps(&hi[d][i]), pv[d], _CMP_GE_OQ));
+				}
+				return _mm256_movemask_ps(m);
+				}, out);
+#else
+			select([&](size_t i) {
+				int m = 0;
+				for (int l = 0; l < WIDTH; l++)
+					m |= (int)(*this)[i + l].contains(p) << l;
+				return m;
+				}, out);
+#endif
+		}
+
+		// Indices of bounds hit by the ray origin + t * dir for t in [0, tMax], by the slab test.
+		// Rays starting exactly on a slab plane with a zero direction component along it may miss.
+		void raycast(const vec_type& origin, const vec_type& dir, const float tMax, std::vector<int>& out) const {
+			const vec_type invDir = 1.f / dir;
+#ifdef __AVX__
+			__m256 o[dim], inv[dim];
+			for (int d = 0; d < dim; d++) {
+				o[d] = _mm256_set1_ps(origin[d]);
+				inv[d] = _mm256_set1_ps(invDir[d]);
+			}
+			const __m256 zero = _mm256_setzero_ps(), tm = _mm256_set1_ps(tMax);
+			select([&](size_t i) {
+				__m256 tNear = zero, tFar = tm;
+				for (int d = 0; d < dim; d++) {
+					const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&lo[d][i]), o[d]), inv[d]);
+					const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&hi[d][i]), o[d]), inv[d]);
+					tNear = _mm256_max_ps(tNear, _mm256_min_ps(t0, t1));
+					tFar = _mm256_min_ps(tFar, _mm256_max_ps(t0, t1));
+				}
+				return _mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+				}, out);
+#else
+			select([&](size_t i) {
+				int m = 0;
+				for (int l = 0; l < WIDTH; l++) {
+					float tNear = 0, tFar = tMax;
+					for (int d = 0; d < dim; d++) {
+						const float t0 = (lo[d][i + l] - origin[d]) * invDir[d];
+						const float t1 = (hi[d][i + l] - origin[d]) * invDir[d];
+						tNear = std::max(tNear, std::min(t0, t1));
+						tFar = std::min(tFar, std::max(t0, t1));
+					}
+					m |= (int)(tNear <= tFar) << l;
+				}
+				return m;
+				}, out);
+#endif
+		}
+	};
+
+	typedef BoundArray<3> BoundArray3;
+
+	// Mesh::bounds of each mesh. Call Mesh::calculateBounds() first if they may be stale.
+	BoundArray<3> meshBounds(const std::vector<Mesh*>& meshes);
+
+	// The bounds of each triangle of the mesh padded by padding
+	BoundArray<3> triangleBounds(const Mesh& mesh, const float padding = 0);
+
+	// Times the batched queries against looping over Bound on n random boxes
+	void boundArrayBenchmark(int n = 1 << 20);
+}
@@ -627,6 +627,51 @@ namespace Kitten {
 		return xx * 4 + yy * 2 + zz;
 	}
 
+	// Spreads the low 21 bits of v to every third bit
+	KITTEN_FUNC_DECL inline uint64_t mortonExpandBits64(uint64_t v) {
+		v &= 0x1fffffull;
+		v = (v | v << 32) & 0x001f00000000ffffull;
+		v = (v | v << 16) & 0x001f0000ff0000ffull;
+		v = (v | v << 8) & 0x100f00f00f00f00full;
+		v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+		v = (v | v << 2) & 0x1249249249249249ull;
+		return v;
+	}
+
+	// 64 bit Morton code of a cell with 21 bits per axis
+	KITTEN_FUNC_DECL inline uint64_t getMorton64(ivec3 cell) {
+		const uint64_t xx = mortonExpandBits64(cell.x);
+		const uint64_t yy = mortonExpandBits64(cell.y);
+		const uint64_t zz = mortonExpandBits64(cell.z);
+		return xx << 2 | yy << 1 | zz;
+	}
+
+	// 64 bit Hilbert code of a cell with 21 bits per axis.
+	// Skilling 2004, "Programming the Hilbert curve", with the branches replaced by masks.
+	KITTEN_FUNC_DECL inline uint64_t getHilbert64(ivec3 cell) {
+		uint32_t x[3] = { cell.x & 0x1fffffu, cell.y & 0x1fffffu, cell.z & 0x1fffffu };
+
+		// Inverse undo
+		for (uint32_t q = 1u << 20; q > 1; q >>= 1) {
+			const uint32_t p = q - 1;
+			x[0] ^= p & (0u - (uint32_t)((x[0] & q) != 0));
+			for (int i = 1; i < 3; i++) {
+				const uint32_t m = 0u - (uint32_t)((x[i] & q) != 0);
+				const uint32_t t = (x[0] ^ x[i]) & p & ~m;
+				x[0] ^= (p & m) | t;
+				x[i] ^= t;
+			}
+		}
+
+		// Gray encode
+		x[1] ^= x[0];
+		x[2] ^= x[1];
+		uint32_t t = 0;
+		for (uint32_t q = 1u << 20; q > 1; q >>= 1)
+			t ^= (q - 1) & (0u - (uint32_t)((x[2] & q) != 0));
+		return getMorton64(ivec3(x[0] ^ t, x[1] ^ t, x[2] ^ t));
+	}
+
 	// Multiples out U.S.V^T
 	template <typename T>
 	KITTEN_FUNC_DECL inline mat<3, 3, T, defaultp> svdMul(mat<3, 3, T, defaultp> U, vec<3, T, defaultp> S, mat<3, 3, T, defaultp> V) {
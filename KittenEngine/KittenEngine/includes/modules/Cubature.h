@@ -0,0 +1,331 @@
+#pragma once
+// Cubature over triangles and tetrahedra, and integrating over every element of a mesh.
+
+#include "Algo.h"
+#include "Mesh.h"
+
+namespace Kitten {
+	// A symmetric cubature rule over a simplex with N vertices.
+	// Point i has barycentric coordinates bary[i] and weight weights[i]. Weights sum to 1.
+	template<int N>
+	struct SimplexRule {
+		int degree;
+		std::vector<vec<N, double, defaultp>> bary;
+		std::vector<double> weights;
+	};
+
+	namespace CubatureRules {
+		// Adds every permutation of (a, b, ..., b) or (a, a, b, b) etc. with weight w
+		template<int N>
+		void addOrbit(SimplexRule<N>& rule, const vec<N, double, defaultp>& p, const double w) {
+			vec<N, double, defaultp> q = p;
+			int c[N];
+			for (int i = 0; i < N; i++) c[i] = i;
+			// Permute indices in lexicographic order and keep distinct points
+			std::sort(c, c + N, [&](int x, int y) { return p[x] < p[y]; });
+			do {
+				for (int i = 0; i < N; i++) q[i] = p[c[i]];
+				bool dup = false;
+				for (auto& b : rule.bary)
+					if (b == q) dup = true;
+				if (!dup) {
+					rule.bary.push_back(q);
+					rule.weights.push_back(w);
+				}
+			} while (std::next_permutation(c, c + N, [&](int x, int y) { return p[x] < p[y]; }));
+		}
+
+		inline SimplexRule<3> makeTriangleRule(int degree) {
+			SimplexRule<3> rule;
+			if (degree <= 1) {
+				rule.degree = 1;
+				addOrbit(rule, dvec3(1. / 3.), 1.);
+			}
+			else if (degree == 2) {
+				rule.degree = 2;
+				addOrbit(rule, dvec3(2. / 3., 1. / 6., 1. / 6.), 1. / 3.);
+			}
+			else {
+				// Radon's 7 point rule
+				rule.degree = 5;
+				const double s = sqrt(15.);
+				const double a = (6 - s) / 21, b = (6 + s) / 21;
+				addOrbit(rule, dvec3(1. / 3.), 9. / 40.);
+				addOrbit(rule, dvec3(1 - 2 * a, a, a), (155 - s) / 1200);
+				addOrbit(rule, dvec3(1 - 2 * b, b, b), (155 + s) / 1200);
+			}
+			return rule;
+		}
+
+		inline SimplexRule<4> makeTetRule(int degree) {
+			SimplexRule<4> rule;
+			if (degree <= 1) {
+				rule.degree = 1;
+				addOrbit(rule, dvec4(0.25), 1.);
+			}
+			else if (degree == 2) {
+				rule.degree = 2;
+				const double a = (5 + 3 * sqrt(5.)) / 20, b = (5 - sqrt(5.)) / 20;
+				addOrbit(rule, dvec4(a, b, b, b), 0.25);
+			}
+			else if (degree == 3) {
+				rule.degree = 3;
+				addOrbit(rule, dvec4(0.25), -0.8);
+				addOrbit(rule, dvec4(0.5, 1. / 6., 1. / 6., 1. / 6.), 0.45);
+			}
+			else {
+				// Keast's 15 point rule
+				rule.degree = 5;
+				const double s = sqrt(15.);
+				const double b1 = (7 - s) / 34, b2 = (7 + s) / 34, a = (10 - 2 * s) / 40;
+				addOrbit(rule, dvec4(0.25), 16. / 135.);
+				addOrbit(rule, dvec4(1 - 3 * b1, b1, b1, b1), (2665 + 14 * s) / 37800);
+				addOrbit(rule, dvec4(1 - 3 * b2, b2, b2, b2), (2665 - 14 * s) / 37800);
+				addOrbit(rule, dvec4(a, a, 0.5 - a, 0.5 - a), 10. / 189.);
+			}
+			return rule;
+		}
+	}
+
+	// A triangle rule exact up to the given degree. Available degrees are 1, 2 and 5.
+	inline const SimplexRule<3>& triangleRule(int degree = 5) {
+		static const SimplexRule<3> rules[3] = {
+			CubatureRules::makeTriangleRule(1), CubatureRules::makeTriangleRule(2), CubatureRules::makeTriangleRule(5) };
+		return rules[degree <= 1 ? 0 : (degree == 2 ? 1 : 2)];
+	}
+
+	// A tetrahedron rule exact up to the given degree. Available degrees are 1, 2, 3 and 5.
+	inline const SimplexRule<4>& tetRule(int degree = 5) {
+		static const SimplexRule<4> rules[4] = {
+			CubatureRules::makeTetRule(1), CubatureRules::makeTetRule(2),
+			CubatureRules::makeTetRule(3), CubatureRules::makeTetRule(5) };
+		return rules[glm::clamp(degree, 1, 4) - 1];
+	}
+
+	// The point with barycentric coordinates bary in the simplex with vertices vs
+	template<int N>
+	dvec3 baryPoint(const dvec3 (&vs)[N], const vec<N, double, defaultp>& bary) {
+		dvec3 x = bary[0] * vs[0];
+		for (int i = 1; i < N; i++) x += bary[i] * vs[i];
+		return x;
+	}
+
+	// Calls f(x, bary) if it takes barycentric coordinates and f(x) otherwise
+	template<typename Func, typename B>
+	auto callCubature(Func& f, const dvec3& x, const B& bary) {
+		if constexpr (std::is_invocable<Func&, const dvec3&, const B&>::value) return f(x, bary);
+		else return f(x);
+	}
+
+	/// <summary>
+	/// Integrates f over the triangle (a, b, c) with a fixed rule.
+	/// f takes the position and optionally the barycentric coordinates, f(x) or f(x, bary).
+	/// </summary>
+	template<typename T, typename Func>
+	T triInt(Func&& f, const dvec3& a, const dvec3& b, const dvec3& c, const SimplexRule<3>& rule = triangleRule()) {
+		const double area = 0.5 * length(cross(b - a, c - a));
+		const dvec3 vs[3] = { a, b, c };
+		T v = rule.weights[0] * callCubature(f, baryPoint(vs, rule.bary[0]), rule.bary[0]);
+		for (size_t i = 1; i < rule.weights.size(); i++)
+			v += rule.weights[i] * callCubature(f, baryPoint(vs, rule.bary[i]), rule.bary[i]);
+		return area * v;
+	}
+
+	/// <summary>
+	/// Integrates f over the tetrahedron (a, b, c, d) with a fixed rule.
+	/// f takes the position and optionally the barycentric coordinates, f(x) or f(x, bary).
+	/// </summary>
+	template<typename T, typename Func>
+	T tetInt(Func&& f, const dvec3& a, const dvec3& b, const dvec3& c, const dvec3& d, const SimplexRule<4>& rule = tetRule()) {
+		const double vol = abs(dot(b - a, cross(c - a, d - a))) / 6;
+		const dvec3 vs[4] = { a, b, c, d };
+		T v = rule.weights[0] * callCubature(f, baryPoint(vs, rule.bary[0]), rule.bary[0]);
+		for (size_t i = 1; i < rule.weights.size(); i++)
+			v += rule.weights[i] * callCubature(f, baryPoint(vs, rule.bary[i]), rule.bary[i]);
+		return vol * v;
+	}
+
+	namespace CubatureRules {
+		// Midpoint subdivision in barycentric coordinates of the root element.
+		// f takes the root barycentric coordinates.
+		template<typename T, typename Func>
+		T adpTri(Func& f, const dvec3 (&bs)[3], const T& coarse, const double tolPerArea,
+			const double rootArea, const int depth, const int maxDepth) {
+			const double area = rootArea / double(1 << (2 * depth));
+			const dvec3 m01 = 0.5 * (bs[0] + bs[1]), m12 = 0.5 * (bs[1] + bs[2]), m02 = 0.5 * (bs[0] + bs[2]);
+			const dvec3 kids[4][3] = { { bs[0], m01, m02 }, { m01, bs[1], m12 }, { m02, m12, bs[2] }, { m12, m02, m01 } };
+
+			const SimplexRule<3>& rule = triangleRule(5);
+			T vals[4];
+			for (int k = 0; k < 4; k++) {
+				T v = rule.weights[0] * f(baryPoint(kids[k], rule.bary[0]));
+				for (size_t i = 1; i < rule.weights.size(); i++)
+					v += rule.weights[i] * f(baryPoint(kids[k], rule.bary[i]));
+				vals[k] = (0.25 * area) * v;
+			}
+
+			T fine = vals[0] + vals[1] + vals[2] + vals[3];
+			if (depth + 1 >= maxDepth || detail::normSqr(fine - coarse) <= pow2(tolPerArea * area))
+				return fine;
+
+			T sum = adpTri(f, kids[0], vals[0], tolPerArea, rootArea, depth + 1, maxDepth);
+			for (int k = 1; k < 4; k++)
+				sum += adpTri(f, kids[k], vals[k], tolPerArea, rootArea, depth + 1, maxDepth);
+			return sum;
+		}
+
+		// Red refinement into 4 corner tets and 4 tets around the m02-m13 diagonal
+		template<typename T, typename Func>
+		T adpTet(Func& f, const dvec4 (&bs)[4], const T& coarse, const double tolPerVol,
+			const double rootVol, const int depth, const int maxDepth) {
+			const double vol = rootVol / double(1 << (3 * depth));
+			const dvec4 m01 = 0.5 * (bs[0] + bs[1]), m02 = 0.5 * (bs[0] + bs[2]), m03 = 0.5 * (bs[0] + bs[3]);
+			const dvec4 m12 = 0.5 * (bs[1] + bs[2]), m13 = 0.5 * (bs[1] + bs[3]), m23 = 0.5 * (bs[2] + bs[3]);
+			const dvec4 kids[8][4] = {
+				{ bs[0], m01, m02, m03 }, { m01, bs[1], m12, m13 }, { m02, m12, bs[2], m23 }, { m03, m13, m23, bs[3] },
+				{ m02, m13, m01, m03 }, { m02, m13, m03, m23 }, { m02, m13, m23, m12 }, { m02, m13, m12, m01 } };
+
+			const SimplexRule<4>& rule = tetRule(5);
+			T vals[8];
+			for (int k = 0; k < 8; k++) {
+				const dmat4 B(kids[k][0], kids[k][1], kids[k][2], kids[k][3]);
+				T v = rule.weights[0] * f(B * rule.bary[0]);
+				for (size_t i = 1; i < rule.weights.size(); i++)
+					v += rule.weights[i] * f(B * rule.bary[i]);
+				vals[k] = (0.125 * vol) * v;
+			}
+
+			T fine = vals[0];
+			for (int k = 1; k < 8; k++) fine += vals[k];
+			if (depth + 1 >= maxDepth || detail::normSqr(fine - coarse) <= pow2(tolPerVol * vol))
+				return fine;
+
+			T sum = adpTet(f, kids[0], vals[0], tolPerVol, rootVol, depth + 1, maxDepth);
+			for (int k = 1; k < 8; k++)
+				sum += adpTet(f, kids[k], vals[k], tolPerVol, rootVol, depth + 1, maxDepth);
+			return sum;
+		}
+	}
+
+	/// <summary>
+	/// Adaptively integrates f over the triangle (a, b, c).
+	/// Each element is split into 4 by its edge midpoints until the degree 5 estimates of
+	/// it and its children agree to within tol scaled by its share of the area.
+	/// </summary>
+	/// <param name="f">The integrand. f(x) or f(x, bary)</param>
+	/// <param name="tol">The error tolerance</param>
+	/// <param name="maxDepth">The most subdivisions. Costs up to 7 * 4^maxDepth evaluations</param>
+	template<typename T, typename Func>
+	T adpTriInt(Func&& f, const dvec3& a, const dvec3& b, const dvec3& c, const double tol = 1e-6, const int maxDepth = 6) {
+		const double area = 0.5 * length(cross(b - a, c - a));
+		if (area == 0) return 0. * triInt<T>(f, a, b, c, triangleRule(1));
+
+		const dmat3 X(a, b, c);
+		auto g = [&](const dvec3& bary) { return callCubature(f, X * bary, bary); };
+		const dvec3 bs[3] = { dvec3(1, 0, 0), dvec3(0, 1, 0), dvec3(0, 0, 1) };
+		const T coarse = triInt<T>(f, a, b, c);
+		return CubatureRules::adpTri<T>(g, bs, coarse, tol / area, area, 0, maxDepth);
+	}
+
+	/// <summary>
+	/// Adaptively integrates f over the tetrahedron (a, b, c, d).
+	/// Each element is split into 8 by its edge midpoints until the degree 5 estimates of
+	/// it and its children agree to within tol scaled by its share of the volume.
+	/// </summary>
+	/// <param name="f">The integrand. f(x) or f(x, bary)</param>
+	/// <param name="tol">The error tolerance</param>
+	/// <param name="maxDepth">The most subdivisions. Costs up to 15 * 8^maxDepth evaluations</param>
+	template<typename T, typename Func>
+	T adpTetInt(Func&& f, const dvec3& a, const dvec3& b, const dvec3& c, const dvec3& d, const double tol = 1e-6, const int maxDepth = 4) {
+		const double vol = abs(dot(b - a, cross(c - a, d - a))) / 6;
+		if (vol == 0) return 0. * tetInt<T>(f, a, b, c, d, tetRule(1));
+
+		const dvec3 vs[4] = { a, b, c, d };
+		auto g = [&](const dvec4& bary) { return callCubature(f, baryPoint(vs, bary), bary); };
+		const dvec4 bs[4] = { dvec4(1, 0, 0, 0), dvec4(0, 1, 0, 0), dvec4(0, 0, 1, 0), dvec4(0, 0, 0, 1) };
+		const T coarse = tetInt<T>(f, a, b, c, d);
+		return CubatureRules::adpTet<T>(g, bs, coarse, tol / vol, vol, 0, maxDepth);
+	}
+
+	/// <summary>
+	/// Integrates f over every triangle of the mesh in parallel.
+	/// f takes (x), (x, bary) or (triangle index, x, bary).
+	/// </summary>
+	/// <param name="mesh">The mesh</param>
+	/// <param name="f">The integrand</param>
+	/// <param name="tol">The error tolerance per triangle. Uses the fixed degree 5 rule if not positive</param>
+	/// <returns>The integral over each triangle</returns>
+	template<typename T, typename Func>
+	std::vector<T> integrateTriangles(Mesh& mesh, Func&& f, const double tol = 0) {
+		const int numTris = (int)(mesh.indices.size() / 3);
+		std::vector<T> vals(numTris);
+
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < numTris; i++) {
+			auto g = [&](const dvec3& x, const dvec3& bary) {
+				if constexpr (std::is_invocable<Func&, int, const dvec3&, const dvec3&>::value) return f(i, x, bary);
+				else return callCubature(f, x, bary);
+				};
+			const dvec3 a = mesh.vertices[mesh.indices[3 * i + 0]].pos;
+			const dvec3 b = mesh.vertices[mesh.indices[3 * i + 1]].pos;
+			const dvec3 c = mesh.vertices[mesh.indices[3 * i + 2]].pos;
+			vals[i] = tol > 0 ? adpTriInt<T>(g, a, b, c, tol) : triInt<T>(g, a, b, c);
+		}
+
+		return vals;
+	}
+
+	/// <summary>
+	/// Integrates f over every tetrahedron of the mesh in parallel.
+	/// f takes (x), (x, bary) or (tet index, x, bary).
+	/// </summary>
+	/// <param name="mesh">The tet mesh</param>
+	/// <param name="f">The integrand</param>
+	/// <param name="tol">The error tolerance per tet. Uses the fixed degree 5 rule if not positive</param>
+	/// <returns>The integral over each tet</returns>
+	template<typename T, typename Func>
+	std::vector<T> integrateTets(TetMesh& mesh, Func&& f, const double tol = 0) {
+		const int numTets = (int)mesh.numTet();
+		std::vector<T> vals(numTets);
+
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < numTets; i++) {
+			auto g = [&](const dvec3& x, const dvec4& bary) {
+				if constexpr (std::is_invocable<Func&, int, const dvec3&, const dvec4&>::value) return f(i, x, bary);
+				else return callCubature(f, x, bary);
+				};
+			const dvec3 a = mesh.vertices[mesh.tetIndices[4 * i + 0]].pos;
+			const dvec3 b = mesh.vertices[mesh.tetIndices[4 * i + 1]].pos;
+			const dvec3 c = mesh.vertices[mesh.tetIndices[4 * i + 2]].pos;
+			const dvec3 d = mesh.vertices[mesh.tetIndices[4 * i + 3]].pos;
+			vals[i] = tol > 0 ? adpTetInt<T>(g, a, b, c, d, tol) : tetInt<T>(g, a, b, c, d);
+		}
+
+		return vals;
+	}
+
+	// Sums per-element integrals in element order so the total does not depend on the thread count.
+	// Empty input gives zero, or an empty vector for dynamically sized Eigen types since their size is unknown.
+	template<typename T>
+	T sumIntegrals(const std::vector<T>& vals) {
+		if (vals.empty()) {
+			if constexpr (std::is_base_of<Eigen::MatrixBase<T>, T>::value) {
+				if constexpr (T::SizeAtCompileTime != Eigen::Dynamic) return T::Zero();
+				else return T();
+			}
+			else return T(0);
+		}
+		T sum = vals[0];
+		for (size_t i = 1; i < vals.size(); i++)
+			sum += vals[i];
+		return sum;
+	}
+
+	inline void testSumIntegrals() {
+		const Eigen::VectorXd dyn = sumIntegrals(std::vector<Eigen::VectorXd>());
+		const Eigen::Vector3d fixed = sumIntegrals(std::vector<Eigen::Vector3d>());
+		const double scalar = sumIntegrals(std::vector<double>());
+		const dvec3 v = sumIntegrals(std::vector<dvec3>{ dvec3(1), dvec3(2) });
+		printf("%d %f %f %f\n", (int)dyn.size(), fixed.norm(), scalar, v.x);
+	}
+}
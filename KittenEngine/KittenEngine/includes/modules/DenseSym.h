@@ -0,0 +1,293 @@
+#pragma once
+// Fixed size symmetric blocks for element Hessians, such as edges (6), triangles (9) and tets (12).
+
+#include <algorithm>
+#include <Eigen/Eigen>
+#include <Eigen/Sparse>
+#include "Common.h"
+
+namespace Kitten {
+	/// <summary>
+	/// A fixed size symmetric N x N matrix stored as its packed upper triangle, row by row.
+	/// Row i holds entries (i, i) to (i, N - 1) contiguously so row updates vectorize.
+	/// No heap allocation, unlike Eigen::MatrixXd.
+	/// </summary>
+	template <int N, typename T>
+	struct DenseSym {
+		static constexpr int DATA_LEN = (N * (N + 1)) / 2;
+		typedef Eigen::Matrix<T, N, N> mat_type;
+		typedef Eigen::Matrix<T, N, 1> vec_type;
+
+		T data[DATA_LEN];
+
+		DenseSym() {}
+
+		// Diagonal matrix with d on the diagonal
+		explicit DenseSym(const T d) {
+			setZero();
+			for (int i = 0; i < N; i++)
+				data[rowStart(i)] = d;
+		}
+
+		explicit DenseSym(const mat_type& m) {
+			for (int i = 0; i < N; i++)
+				for (int j = i; j < N; j++)
+					data[rowStart(i) + j - i] = m(i, j);
+		}
+
+		// Expands to a full Eigen matrix
+		mat_type matrix() const {
+			mat_type m;
+			for (int i = 0; i < N; i++)
+				for (int j = i; j < N; j++)
+					m(i, j) = m(j, i) = data[rowStart(i) + j - i];
+			return m;
+		}
+
+		// Start of row i in data
+		static constexpr int rowStart(const int i) {
+			return i * N - (i * (i - 1)) / 2;
+		}
+
+		// Index into data of entry (i, j)
+		static constexpr int index(const int i, const int j) {
+			return i <= j ? rowStart(i) + j - i : rowStart(j) + i - j;
+		}
+
+		T& operator()(const int i, const int j) { return data[index(i, j)]; }
+		const T& operator()(const int i, const int j) const { return data[index(i, j)]; }
+
+		T& operator[](const int i) { return data[i]; }
+		const T& operator[](const int i) const { return data[i]; }
+
+		void setZero() {
+			for (int k = 0; k < DATA_LEN; k++)
+				data[k] = 0;
+		}
+
+		DenseSym& operator+=(const DenseSym& o) {
+			for (int k = 0; k < DATA_LEN; k++)
+				data[k] += o.data[k];
+			return *this;
+		}
+
+		DenseSym& operator-=(const DenseSym& o) {
+			for (int k = 0; k < DATA_LEN; k++)
+				data[k] -= o.data[k];
+			return *this;
+		}
+
+		DenseSym& operator*=(const T s) {
+			for (int k = 0; k < DATA_LEN; k++)
+				data[k] *= s;
+			return *this;
+		}
+
+		DenseSym operator+(const DenseSym& o) const { DenseSym r(*this); return r += o; }
+		DenseSym operator-(const DenseSym& o) const { DenseSym r(*this); return r -= o; }
+		DenseSym operator*(const T s) const { DenseSym r(*this); return r *= s; }
+
+		// this += s * v v^T
+		void addOuter(const T* __restrict v, const T s = 1) {
+			for (int i = 0; i < N; i++) {
+				T* __restrict row = data + rowStart(i);
+				const T si = s * v[i];
+				for (int j = i; j < N; j++)
+					row[j - i] += si * v[j];
+			}
+		}
+
+		// this += s * (a b^T + b a^T)
+		void addOuter(const T* __restrict a, const T* __restrict b, const T s) {
+			for (int i = 0; i < N; i++) {
+				T* __restrict row = data + rowStart(i);
+				const T sa = s * a[i], sb = s * b[i];
+				for (int j = i; j < N; j++)
+					row[j - i] += sa * b[j] + sb * a[j];
+			}
+		}
+
+		// this += s * J^T J for a M x N jacobian stored row major
+		template <int M>
+		void addJTJ(const T* __restrict J, const T s = 1) {
+			for (int r = 0; r < M; r++)
+				addOuter(J + r * N, s);
+		}
+
+		void addOuter(const vec_type& v, const T s = 1) { addOuter(v.data(), s); }
+
+		// y = this * x
+		void multiply(const T* __restrict x, T* __restrict y) const {
+			for (int i = 0; i < N; i++)
+				y[i] = 0;
+			for (int i = 0; i < N; i++) {
+				const T* __restrict row = data + rowStart(i);
+				T acc = row[0] * x[i];
+				for (int j = i + 1; j < N; j++) {
+					acc += row[j - i] * x[j];
+					y[j] += row[j - i] * x[i];
+				}
+				y[i] += acc;
+			}
+		}
+
+		vec_type operator*(const vec_type& x) const {
+			vec_type y;
+			multiply(x.data(), y.data());
+			return y;
+		}
+
+		// Whether all eigenvalues are above minEig, by LDL^T of A - minEig I
+		bool isPD(const T minEig = 0) const {
+			T f[DATA_LEN];
+			for (int k = 0; k < DATA_LEN; k++)
+				f[k] = data[k];
+			for (int i = 0; i < N; i++)
+				f[rowStart(i)] -= minEig;
+
+			// Right looking LDL^T on the packed upper triangle. U = D L^T is kept unscaled.
+			for (int k = 0; k < N; k++) {
+				const T d = f[rowStart(k)];
+				if (!(d > 0)) return false;
+				const T invD = 1 / d;
+				const T* __restrict rk = f + rowStart(k);
+				for (int i = k + 1; i < N; i++) {
+					T* __restrict ri = f + rowStart(i);
+					const T l = rk[i - k] * invD;
+					for (int j = i; j < N; j++)
+						ri[j - i] -= l * rk[j - k];
+				}
+			}
+			return true;
+		}
+
+		// Eigen decomposition with eigenvalues in ascending order
+		void eigen(vec_type& vals, mat_type& vecs) const {
+			Eigen::SelfAdjointEigenSolver<mat_type> solver(matrix());
+			vals = solver.eigenvalues();
+			vecs = solver.eigenvectors();
+		}
+
+		// Projects onto the symmetric positive semi-definite matrices by clamping eigenvalues to at least minEig.
+		// Matrices that are already positive definite skip the eigen decomposition.
+		DenseSym projectSPD(const T minEig = 0) const {
+			if (isPD(minEig)) return *this;
+
+			vec_type vals;
+			mat_type vecs;
+			eigen(vals, vecs);
+
+			DenseSym r(T(0));
+			for (int k = 0; k < N; k++) {
+				const T l = std::max(vals[k], minEig);
+				if (l != 0) r.addOuter(vecs.col(k).data(), l);
+			}
+			return r;
+		}
+
+		// Slot of (i, j) for every (i, j) in the nonzeros of K, where i and j index dofs.
+		// Returns false if any entry is missing from the pattern.
+		template <int Options, typename Index>
+		static bool csrSlots(const Eigen::SparseMatrix<T, Options, Index>& K, const int dofs[N], int slots[N * N]) {
+			static_assert(Options & Eigen::RowMajor, "K must be row major");
+			const Index* outer = K.outerIndexPtr();
+			const Index* inner = K.innerIndexPtr();
+			bool found = true;
+			for (int i = 0; i < N; i++) {
+				const Index* begin = inner + outer[dofs[i]];
+				const Index* end = inner + outer[dofs[i] + 1];
+				for (int j = 0; j < N; j++) {
+					const Index* itr = std::lower_bound(begin, end, (Index)dofs[j]);
+					const bool hit = itr != end && *itr == dofs[j];
+					slots[i * N + j] = hit ? (int)(itr - inner) : -1;
+					found = found && hit;
+				}
+			}
+			return found;
+		}
+
+		// Adds this into the compressed row major K at rows and columns dofs. Entries missing from the pattern are skipped.
+		// Set atomic when elements sharing dofs are scattered from several threads.
+		template <int Options, typename Index>
+		void scatter(Eigen::SparseMatrix<T, Options, Index>& K, const int dofs[N], const bool atomic = false) const {
+			int slots[N * N];
+			csrSlots(K, dofs, slots);
+			scatter(K.valuePtr(), slots, atomic);
+		}
+
+		// Adds this into a value array at precomputed slots from csrSlots()
+		void scatter(T* values, const int slots[N * N], const bool atomic = false) const {
+			for (int i = 0; i < N; i++)
+				for (int j = 0; j < N; j++) {
+					const int s = slots[i * N + j];
+					if (s < 0) continue;
+					const T v = data[index(i, j)];
+					if (atomic) {
+#pragma omp atomic
+						values[s] += v;
+					}
+					else values[s] += v;
+				}
+		}
+	};
+
+	// The dofs of an element with M nodes of D dofs each, interleaved per node
+	template <int D, int M>
+	inline void elementDofs(const int nodes[M], int dofs[D * M]) {
+		for (int n = 0; n < M; n++)
+			for (int d = 0; d < D; d++)
+				dofs[D * n + d] = D * nodes[n] + d;
+	}
+
+	typedef DenseSym<6, double> edgeHess;
+	typedef DenseSym<9, double> triHess;
+	typedef DenseSym<12, double> tetHess;
+
+	template <int N>
+	inline void benchDenseSymN(const int itr) {
+		StopWatch timer;
+		timer.gpuSync = false;
+		double sink = 0;
+
+		// Random jacobians of 3 rows, like a strain or normal term
+		std::vector<double> J(3 * N * 64);
+		for (size_t i = 0; i < J.size(); i++)
+			J[i] = sin(0.37 * i + 0.1 * N);
+
+		timer.reset();
+		for (int k = 0; k < itr; k++) {
+			DenseSym<N, double> H(1e-3 * (k % 7 - 3));
+			H.template addJTJ<3>(J.data() + 3 * N * (k % 64), 1.0 + 1e-6 * k);
+			H.addOuter(J.data() + 3 * N * ((k + 1) % 64), -0.5);
+			H = H.projectSPD();
+			sink += H[k % DenseSym<N, double>::DATA_LEN];
+		}
+		timer.time();
+		const double tDense = timer.deltaTimes.back();
+
+		timer.reset();
+		for (int k = 0; k < itr; k++) {
+			Eigen::MatrixXd H = Eigen::MatrixXd::Identity(N, N) * (1e-3 * (k % 7 - 3));
+			Eigen::Map<const Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>> Jm(J.data() + 3 * N * (k % 64), 3, N);
+			Eigen::Map<const Eigen::VectorXd> v(J.data() + 3 * N * ((k + 1) % 64), N);
+			H += (1.0 + 1e-6 * k) * Jm.transpose() * Jm;
+			H -= 0.5 * v * v.transpose();
+			Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> solver(H);
+			Eigen::VectorXd vals = solver.eigenvalues().cwiseMax(0);
+			H = solver.eigenvectors() * vals.asDiagonal() * solver.eigenvectors().transpose();
+			sink += H(k % N, (k / N) % N);
+		}
+		timer.time();
+		const double tEigen = timer.deltaTimes.back();
+
+		printf("N=%2d DenseSym %8.3f us  Eigen::MatrixXd %8.3f us  (checksum %g)\n",
+			N, 1e6 * tDense / itr, 1e6 * tEigen / itr, sink);
+	}
+
+	// Times JTJ accumulation plus SPD projection of DenseSym against Eigen::MatrixXd for N = 6, 9 and 12
+	inline void benchDenseSym(const int itr = 100000) {
+		benchDenseSymN<6>(itr);
+		benchDenseSymN<9>(itr);
+		benchDenseSymN<12>(itr);
+	}
+}
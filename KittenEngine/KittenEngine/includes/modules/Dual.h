@@ -0,0 +1,367 @@
+#pragma once
+
+#include <limits>
+#include <type_traits>
+#include "Common.h"
+
+namespace Kitten {
+	template <typename T, int N>
+	constexpr int dualAlignment() {
+		// Align to the full width when the lanes fill a power of two up to an AVX register
+		constexpr int size = (int)sizeof(T) * (N + 1);
+		return (size <= 32 && (size & (size - 1)) == 0) ? size : (int)alignof(T);
+	}
+
+	/// <summary>
+	/// A forward-mode dual number carrying N derivative lanes.
+	/// Behaves like a scalar so it can be used as the component type of glm vectors and matrices,
+	/// SymMat and RotorX. Math functions are hidden friends so they are found through ADL
+	/// without hiding the glm overloads used elsewhere in Kitten.
+	/// The lanes are laid out contiguously (and aligned when possible) so that the
+	/// fixed-length loops vectorize.
+	/// </summary>
+	/// <typeparam name="T">the underlying real type</typeparam>
+	/// <typeparam name="N">the number of derivative lanes</typeparam>
+	template <typename T, int N>
+	struct alignas(dualAlignment<T, N>()) Dual {
+		static_assert(N > 0, "Dual requires at least one derivative lane");
+		typedef T value_type;
+		static constexpr int NUM_LANES = N;
+
+		T grad[N];	// The partial derivatives
+		T val;		// The value
+
+		Dual() = default;
+
+		constexpr KITTEN_FUNC_DECL Dual(const T v) : grad{}, val(v) {}
+
+		// Creates the independent variable for lane i
+		constexpr KITTEN_FUNC_DECL static Dual var(const T v, const int i) {
+			Dual r(v);
+			r.grad[i] = 1;
+			return r;
+		}
+
+		// Creates independent variables for the components of x in lanes [offset, offset + M)
+		template <int M>
+		constexpr KITTEN_FUNC_DECL static vec<M, Dual, defaultp> vars(const vec<M, T, defaultp> x, const int offset = 0) {
+			vec<M, Dual, defaultp> r;
+			for (int i = 0; i < M; i++)
+				r[i] = var(x[i], offset + i);
+			return r;
+		}
+
+		// Gets the derivative lanes [offset, offset + M) as a vector
+		template <int M>
+		constexpr KITTEN_FUNC_DECL vec<M, T, defaultp> gradient(const int offset = 0) const {
+			vec<M, T, defaultp> g;
+			for (int i = 0; i < M; i++)
+				g[i] = grad[offset + i];
+			return g;
+		}
+
+		KITTEN_FUNC_DECL explicit operator T() const {
+			return val;
+		}
+
+		// Arithmetic
+		constexpr KITTEN_FUNC_DECL Dual operator-() const {
+			Dual r;
+			for (int i = 0; i < N; i++) r.grad[i] = -grad[i];
+			r.val = -val;
+			return r;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual operator+() const {
+			return *this;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual& operator+=(const Dual& b) {
+			for (int i = 0; i < N; i++) grad[i] += b.grad[i];
+			val += b.val;
+			return *this;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual& operator-=(const Dual& b) {
+			for (int i = 0; i < N; i++) grad[i] -= b.grad[i];
+			val -= b.val;
+			return *this;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual& operator*=(const Dual& b) {
+			for (int i = 0; i < N; i++) grad[i] = grad[i] * b.val + val * b.grad[i];
+			val *= b.val;
+			return *this;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual& operator/=(const Dual& b) {
+			const T inv = 1 / b.val;
+			const T q = val * inv;
+			for (int i = 0; i < N; i++) grad[i] = (grad[i] - q * b.grad[i]) * inv;
+			val = q;
+			return *this;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual& operator+=(const T b) { val += b; return *this; }
+		constexpr KITTEN_FUNC_DECL Dual& operator-=(const T b) { val -= b; return *this; }
+
+		constexpr KITTEN_FUNC_DECL Dual& operator*=(const T b) {
+			for (int i = 0; i < N; i++) grad[i] *= b;
+			val *= b;
+			return *this;
+		}
+
+		constexpr KITTEN_FUNC_DECL Dual& operator/=(const T b) {
+			return *this *= 1 / b;
+		}
+
+		constexpr KITTEN_FUNC_DECL friend Dual operator+(Dual a, const Dual& b) { return a += b; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator-(Dual a, const Dual& b) { return a -= b; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator*(Dual a, const Dual& b) { return a *= b; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator/(Dual a, const Dual& b) { return a /= b; }
+
+		constexpr KITTEN_FUNC_DECL friend Dual operator+(Dual a, const T b) { return a += b; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator-(Dual a, const T b) { return a -= b; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator*(Dual a, const T b) { return a *= b; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator/(Dual a, const T b) { return a /= b; }
+
+		constexpr KITTEN_FUNC_DECL friend Dual operator+(const T a, Dual b) { return b += a; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator-(const T a, const Dual& b) { return -b + a; }
+		constexpr KITTEN_FUNC_DECL friend Dual operator*(const T a, Dual b) { return b *= a; }
+
+		constexpr KITTEN_FUNC_DECL friend Dual operator/(const T a, const Dual& b) {
+			Dual r;
+			const T inv = 1 / b.val;
+			r.val = a * inv;
+			const T s = -r.val * inv;
+			for (int i = 0; i < N; i++) r.grad[i] = s * b.grad[i];
+			return r;
+		}
+
+		// Comparisons only look at the value
+		constexpr KITTEN_FUNC_DECL friend bool operator==(const Dual& a, const Dual& b) { return a.val == b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator!=(const Dual& a, const Dual& b) { return a.val != b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator<(const Dual& a, const Dual& b) { return a.val < b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator>(const Dual& a, const Dual& b) { return a.val > b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator<=(const Dual& a, const Dual& b) { return a.val <= b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator>=(const Dual& a, const Dual& b) { return a.val >= b.val; }
+
+		constexpr KITTEN_FUNC_DECL friend bool operator==(const Dual& a, const T b) { return a.val == b; }
+		constexpr KITTEN_FUNC_DECL friend bool operator!=(const Dual& a, const T b) { return a.val != b; }
+		constexpr KITTEN_FUNC_DECL friend bool operator<(const Dual& a, const T b) { return a.val < b; }
+		constexpr KITTEN_FUNC_DECL friend bool operator>(const Dual& a, const T b) { return a.val > b; }
+		constexpr KITTEN_FUNC_DECL friend bool operator<=(const Dual& a, const T b) { return a.val <= b; }
+		constexpr KITTEN_FUNC_DECL friend bool operator>=(const Dual& a, const T b) { return a.val >= b; }
+
+		constexpr KITTEN_FUNC_DECL friend bool operator==(const T a, const Dual& b) { return a == b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator!=(const T a, const Dual& b) { return a != b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator<(const T a, const Dual& b) { return a < b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator>(const T a, const Dual& b) { return a > b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator<=(const T a, const Dual& b) { return a <= b.val; }
+		constexpr KITTEN_FUNC_DECL friend bool operator>=(const T a, const Dual& b) { return a >= b.val; }
+
+		// Applies the chain rule given f(val) and f'(val)
+		constexpr KITTEN_FUNC_DECL static Dual chain(const Dual& a, const T f, const T df) {
+			Dual r;
+			for (int i = 0; i < N; i++) r.grad[i] = df * a.grad[i];
+			r.val = f;
+			return r;
+		}
+
+		// Math functions
+		KITTEN_FUNC_DECL friend Dual sqrt(const Dual& a) {
+			const T s = glm::sqrt(a.val);
+			return chain(a, s, T(0.5) / s);
+		}
+
+		KITTEN_FUNC_DECL friend Dual inversesqrt(const Dual& a) {
+			const T s = 1 / glm::sqrt(a.val);
+			return chain(a, s, T(-0.5) * s / a.val);
+		}
+
+		KITTEN_FUNC_DECL friend Dual cbrt(const Dual& a) {
+			const T s = glm::pow(a.val, T(1) / 3);
+			return chain(a, s, s / (3 * a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual exp(const Dual& a) {
+			const T e = glm::exp(a.val);
+			return chain(a, e, e);
+		}
+
+		KITTEN_FUNC_DECL friend Dual log(const Dual& a) {
+			return chain(a, glm::log(a.val), 1 / a.val);
+		}
+
+		KITTEN_FUNC_DECL friend Dual pow(const Dual& a, const T p) {
+			const T s = glm::pow(a.val, p - 1);
+			return chain(a, s * a.val, p * s);
+		}
+
+		KITTEN_FUNC_DECL friend Dual pow(const Dual& a, const Dual& p) {
+			return exp(p * log(a));
+		}
+
+		KITTEN_FUNC_DECL friend Dual sin(const Dual& a) {
+			return chain(a, glm::sin(a.val), glm::cos(a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual cos(const Dual& a) {
+			return chain(a, glm::cos(a.val), -glm::sin(a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual tan(const Dual& a) {
+			const T t = glm::tan(a.val);
+			return chain(a, t, 1 + t * t);
+		}
+
+		KITTEN_FUNC_DECL friend Dual asin(const Dual& a) {
+			return chain(a, glm::asin(a.val), 1 / glm::sqrt(1 - a.val * a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual acos(const Dual& a) {
+			return chain(a, glm::acos(a.val), -1 / glm::sqrt(1 - a.val * a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual atan(const Dual& a) {
+			return chain(a, glm::atan(a.val), 1 / (1 + a.val * a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual atan2(const Dual& y, const Dual& x) {
+			Dual r;
+			const T inv = 1 / (x.val * x.val + y.val * y.val);
+			for (int i = 0; i < N; i++) r.grad[i] = (x.val * y.grad[i] - y.val * x.grad[i]) * inv;
+			r.val = glm::atan(y.val, x.val);
+			return r;
+		}
+
+		// glm spells atan2 as a two argument atan
+		KITTEN_FUNC_DECL friend Dual atan(const Dual& y, const Dual& x) {
+			return atan2(y, x);
+		}
+
+		KITTEN_FUNC_DECL friend Dual sinh(const Dual& a) {
+			return chain(a, glm::sinh(a.val), glm::cosh(a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual cosh(const Dual& a) {
+			return chain(a, glm::cosh(a.val), glm::sinh(a.val));
+		}
+
+		KITTEN_FUNC_DECL friend Dual tanh(const Dual& a) {
+			const T t = glm::tanh(a.val);
+			return chain(a, t, 1 - t * t);
+		}
+
+		constexpr KITTEN_FUNC_DECL friend Dual abs(const Dual& a) {
+			return a.val < 0 ? -a : a;
+		}
+
+		constexpr KITTEN_FUNC_DECL friend Dual sign(const Dual& a) {
+			return Dual(T((a.val > 0) - (a.val < 0)));
+		}
+
+		constexpr KITTEN_FUNC_DECL friend Dual min(const Dual& a, const Dual& b) {
+			return b.val < a.val ? b : a;
+		}
+
+		constexpr KITTEN_FUNC_DECL friend Dual max(const Dual& a, const Dual& b) {
+			return a.val < b.val ? b : a;
+		}
+
+		constexpr KITTEN_FUNC_DECL friend Dual clamp(const Dual& a, const Dual& lo, const Dual& hi) {
+			return min(max(a, lo), hi);
+		}
+
+		// Piecewise constant functions have zero derivatives
+		KITTEN_FUNC_DECL friend Dual floor(const Dual& a) { return Dual(glm::floor(a.val)); }
+		KITTEN_FUNC_DECL friend Dual ceil(const Dual& a) { return Dual(glm::ceil(a.val)); }
+		KITTEN_FUNC_DECL friend Dual round(const Dual& a) { return Dual(glm::round(a.val)); }
+
+		KITTEN_FUNC_DECL friend Dual fract(const Dual& a) {
+			return chain(a, a.val - glm::floor(a.val), 1);
+		}
+
+		KITTEN_FUNC_DECL friend bool isnan(const Dual& a) { return glm::isnan(a.val); }
+		KITTEN_FUNC_DECL friend bool isinf(const Dual& a) { return glm::isinf(a.val); }
+		KITTEN_FUNC_DECL friend bool isfinite(const Dual& a) {
+			bool finite = !glm::isnan(a.val) && !glm::isinf(a.val);
+			for (int i = 0; i < N; i++) finite &= !glm::isnan(a.grad[i]) && !glm::isinf(a.grad[i]);
+			return finite;
+		}
+	};
+
+	typedef Dual<float, 1> dualf;
+	typedef Dual<double, 1> duald;
+	typedef Dual<float, 3> dual3f;
+	typedef Dual<double, 3> dual3d;
+
+	template <typename T, int N>
+	KITTEN_FUNC_DECL void print(Dual<T, N> v, const char* format = "%.4f") {
+		printf(format, v.val);
+		printf(" {");
+		for (int i = 0; i < N; i++) {
+			printf(format, v.grad[i]);
+			if (i != N - 1) printf(", ");
+		}
+		printf("}\n");
+	}
+
+	/// <summary>
+	/// Exact drop-in for nDiff() using forward-mode autodiff.
+	/// f must be callable with the Dual version of T (e.g. a generic lambda).
+	/// </summary>
+	/// <param name="f">the scalar function. Can be over a scalar or a glm vector</param>
+	/// <param name="x">the point to differentiate at</param>
+	/// <returns>the gradient of f at x</returns>
+	template<typename T, typename Func>
+	KITTEN_FUNC_DECL T autoDiff(Func&& f, T x) {
+		if constexpr (std::is_arithmetic<T>::value)
+			return f(Dual<T, 1>::var(x, 0)).grad[0];
+		else {
+			typedef typename T::value_type S;
+			constexpr int M = T::length();
+			return f(Dual<S, M>::template vars<M>(x)).template gradient<M>();
+		}
+	}
+
+	/// <summary>
+	/// Exact drop-in for nDiff() using forward-mode autodiff.
+	/// </summary>
+	/// <param name="f">the glm vector valued function of a single variable</param>
+	/// <param name="x">the point to differentiate at</param>
+	/// <returns>the derivative of f at x</returns>
+	template<typename T, typename Func>
+	KITTEN_FUNC_DECL std::enable_if_t<!std::is_arithmetic<T>::value, T> autoDiff(Func&& f, double x) {
+		typedef typename T::value_type S;
+		auto r = f(Dual<S, 1>::var((S)x, 0));
+		T g;
+		for (int i = 0; i < T::length(); i++)
+			g[i] = r[i].grad[0];
+		return g;
+	}
+
+	/// <summary>
+	/// Computes the jacobian of a vector valued function with forward-mode autodiff in a single evaluation.
+	/// </summary>
+	/// <param name="f">the glm vector valued function of a glm vector</param>
+	/// <param name="x">the point to differentiate at</param>
+	/// <returns>the jacobian where column i is df/dx_i</returns>
+	template<typename T, int N, typename Func>
+	KITTEN_FUNC_DECL auto autoJacobian(Func&& f, vec<N, T, defaultp> x) {
+		auto r = f(Dual<T, N>::template vars<N>(x));
+		constexpr int M = decltype(r)::length();
+
+		mat<N, M, T, defaultp> J;
+		for (int i = 0; i < N; i++)
+			for (int k = 0; k < M; k++)
+				J[i][k] = r[k].grad[i];
+		return J;
+	}
+}
+
+namespace std {
+	// Lets glm treat Dual as a floating point type
+	template <typename T, int N>
+	class numeric_limits<Kitten::Dual<T, N>> : public numeric_limits<T> {};
+}
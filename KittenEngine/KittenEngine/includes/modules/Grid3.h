@@ -0,0 +1,317 @@
+#pragma once
+// Dense 3D grids stored in Morton ordered bricks.
+
+#include <vector>
+#include <bitset>
+#include "Common.h"
+#include "Bound.h"
+
+namespace Kitten {
+	/// <summary>
+	/// The layout shared by every Grid3. Cells are grouped into 4x4x4 bricks stored one after another,
+	/// with cells inside a brick in getMorton() order, so most face neighbors of a cell share its brick.
+	/// Nodes are placed so cell 0 is at domain.min and cell dim() - 1 is at domain.max.
+	/// </summary>
+	class Grid3Layout {
+	public:
+		static constexpr int BRICK_BITS = 2;
+		static constexpr int BRICK = 1 << BRICK_BITS;					// Cells per brick along each axis
+		static constexpr int BRICK_SIZE = BRICK * BRICK * BRICK;	// Cells per brick
+
+		Bound<> domain = Bound<>(vec3(0), vec3(1));
+
+	protected:
+		ivec3 dims = ivec3(0);
+		ivec3 bricks = ivec3(0);
+
+		void setDims(const ivec3 d) {
+			dims = glm::max(d, ivec3(0));
+			bricks = (dims + (BRICK - 1)) >> BRICK_BITS;
+		}
+
+		// Calls f(cell, local) for every cell of brick b inside the grid
+		template<typename F>
+		void forCellsInBrick(const int b, const F& f) const {
+			const ivec3 base = unflatIdx(b, bricks) << BRICK_BITS;
+			const ivec3 end = glm::min(base + BRICK, dims);
+			for (int z = base.z; z < end.z; z++)
+				for (int y = base.y; y < end.y; y++)
+					for (int x = base.x; x < end.x; x++) {
+						const ivec3 cell(x, y, z);
+						f(cell, localIndex(cell));
+					}
+		}
+
+	public:
+		ivec3 dim() const { return dims; }
+		size_t numCells() const { return (size_t)dims.x * dims.y * dims.z; }
+		int numBricks() const { return bricks.x * bricks.y * bricks.z; }
+
+		bool inside(const ivec3 cell) const {
+			return all(greaterThanEqual(cell, ivec3(0))) && all(lessThan(cell, dims));
+		}
+
+		ivec3 clampCell(const ivec3 cell) const {
+			return glm::clamp(cell, ivec3(0), dims - 1);
+		}
+
+		// Index of cell within its brick
+		static int localIndex(const ivec3 cell) {
+			return (int)getMorton(cell & (BRICK - 1));
+		}
+
+		int brickIndex(const ivec3 cell) const {
+			return flatIdx(cell >> BRICK_BITS, bricks);
+		}
+
+		// Index of cell in the bricked storage
+		size_t index(const ivec3 cell) const {
+			return (size_t)brickIndex(cell) * BRICK_SIZE + localIndex(cell);
+		}
+
+		// The position of the node at cell
+		vec3 nodePos(const ivec3 cell) const {
+			return domain.interp(vec3(cell) / vec3(glm::max(dims - 1, ivec3(1))));
+		}
+
+		// The cell at or below pos and the trilinear weights within it, clamped to the grid
+		ivec3 sampleCell(const vec3 pos, vec3& t) const {
+			const vec3 g = glm::clamp(domain.normCoord(pos) * vec3(dims - 1), vec3(0), vec3(glm::max(dims - 1, ivec3(0))));
+			const ivec3 cell = glm::min(ivec3(glm::floor(g)), glm::max(dims - 2, ivec3(0)));
+			t = g - vec3(cell);
+			return cell;
+		}
+	};
+
+	/// <summary>
+	/// A dense 3D grid of T in bricked Morton order. Bulk operations run in parallel over bricks.
+	/// </summary>
+	template<typename T>
+	class Grid3 : public Grid3Layout {
+		std::vector<T> data;
+
+	public:
+		Grid3() {}
+
+		Grid3(const ivec3 dims, const T& v = T()) {
+			resize(dims, v);
+		}
+
+		Grid3(const ivec3 dims, const Bound<>& domain, const T& v = T()) {
+			this->domain = domain;
+			resize(dims, v);
+		}
+
+		// Resizes the grid and sets every cell to v
+		void resize(const ivec3 d, const T& v = T()) {
+			setDims(d);
+			data.assign((size_t)numBricks() * BRICK_SIZE, v);
+		}
+
+		T& operator()(const ivec3 cell) { return data[index(cell)]; }
+		const T& operator()(const ivec3 cell) const { return data[index(cell)]; }
+		T& operator()(const int x, const int y, const int z) { return data[index(ivec3(x, y, z))]; }
+		const T& operator()(const int x, const int y, const int z) const { return data[index(ivec3(x, y, z))]; }
+
+		// The raw bricked storage, including padding cells of partial bricks
+		T* rawData() { return data.data(); }
+		const T* rawData() const { return data.data(); }
+
+		void fill(const T& v) {
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)data.size(); i++)
+				data[i] = v;
+		}
+
+		// Calls f(cell, value) for every cell
+		template<typename F>
+		void forEach(const F& f) {
+			const int nb = numBricks();
+#pragma omp parallel for schedule(static, 64)
+			for (int b = 0; b < nb; b++) {
+				T* brick = data.data() + (size_t)b * BRICK_SIZE;
+				forCellsInBrick(b, [&](const ivec3 cell, const int l) { f(cell, brick[l]); });
+			}
+		}
+
+		template<typename F>
+		void forEach(const F& f) const {
+			const int nb = numBricks();
+#pragma omp parallel for schedule(static, 64)
+			for (int b = 0; b < nb; b++) {
+				const T* brick = data.data() + (size_t)b * BRICK_SIZE;
+				forCellsInBrick(b, [&](const ivec3 cell, const int l) { f(cell, brick[l]); });
+			}
+		}
+
+		// Sets every cell to f(cell, value)
+		template<typename F>
+		void map(const F& f) {
+			forEach([&](const ivec3 cell, T& v) { v = f(cell, v); });
+		}
+
+		// Folds f(cell, value) over every cell with op. init must be the identity of op.
+		template<typename R, typename F, typename Op>
+		R reduce(const R& init, const F& f, const Op& op) const {
+			R result = init;
+			const int nb = numBricks();
+#pragma omp parallel
+			{
+				R local = init;
+#pragma omp for schedule(static, 64)
+				for (int b = 0; b < nb; b++) {
+					const T* brick = data.data() + (size_t)b * BRICK_SIZE;
+					forCellsInBrick(b, [&](const ivec3 cell, const int l) { local = op(local, f(cell, brick[l])); });
+				}
+#pragma omp critical
+				result = op(result, local);
+			}
+			return result;
+		}
+
+		// Calls f(cell, value, nbrs) for every cell, where nbrs holds the 6 face neighbors
+		// ordered -x, +x, -y, +y, -z, +z and clamped to the grid.
+		// Neighbors inside the same brick are found from the brick offset alone.
+		template<typename F>
+		void forEachStencil(const F& f) const {
+			const int nb = numBricks();
+#pragma omp parallel for schedule(static, 64)
+			for (int b = 0; b < nb; b++) {
+				const T* brick = data.data() + (size_t)b * BRICK_SIZE;
+				forCellsInBrick(b, [&](const ivec3 cell, const int l) {
+					T nbrs[6];
+					for (int axis = 0; axis < 3; axis++)
+						for (int s = 0; s < 2; s++) {
+							ivec3 n = cell;
+							n[axis] += 2 * s - 1;
+							n = clampCell(n);
+							nbrs[2 * axis + s] = ((n[axis] >> BRICK_BITS) == (cell[axis] >> BRICK_BITS))
+								? brick[localIndex(n)] : data[index(n)];
+						}
+					f(cell, brick[l], (const T*)nbrs);
+					});
+			}
+		}
+
+		// Trilinear interpolation at pos, clamped to the domain
+		T sample(const vec3 pos) const {
+			vec3 t;
+			const ivec3 c0 = sampleCell(pos, t);
+			const ivec3 c1 = glm::min(c0 + 1, glm::max(dims - 1, ivec3(0)));
+			auto lerp = [](const T& a, const T& b, const float t) { return (1 - t) * a + t * b; };
+			const T x00 = lerp((*this)(c0.x, c0.y, c0.z), (*this)(c1.x, c0.y, c0.z), t.x);
+			const T x10 = lerp((*this)(c0.x, c1.y, c0.z), (*this)(c1.x, c1.y, c0.z), t.x);
+			const T x01 = lerp((*this)(c0.x, c0.y, c1.z), (*this)(c1.x, c0.y, c1.z), t.x);
+			const T x11 = lerp((*this)(c0.x, c1.y, c1.z), (*this)(c1.x, c1.y, c1.z), t.x);
+			return lerp(lerp(x00, x10, t.y), lerp(x01, x11, t.y), t.z);
+		}
+	};
+
+	/// <summary>
+	/// A bit packed occupancy grid. Each 4x4x4 brick is one 64 bit word in Morton order.
+	/// set() is not thread safe for cells in the same brick. The bulk operations are.
+	/// </summary>
+	template<>
+	class Grid3<bool> : public Grid3Layout {
+		std::vector<uint64_t> words;
+
+	public:
+		Grid3() {}
+
+		Grid3(const ivec3 dims, const bool v = false) {
+			resize(dims, v);
+		}
+
+		Grid3(const ivec3 dims, const Bound<>& domain, const bool v = false) {
+			this->domain = domain;
+			resize(dims, v);
+		}
+
+		void resize(const ivec3 d, const bool v = false) {
+			setDims(d);
+			words.assign(numBricks(), v ? ~0ull : 0ull);
+		}
+
+		bool operator()(const ivec3 cell) const {
+			return (words[brickIndex(cell)] >> localIndex(cell)) & 1;
+		}
+
+		bool operator()(const int x, const int y, const int z) const {
+			return (*this)(ivec3(x, y, z));
+		}
+
+		void set(const ivec3 cell, const bool v) {
+			const uint64_t bit = 1ull << localIndex(cell);
+			uint64_t& w = words[brickIndex(cell)];
+			w = v ? (w | bit) : (w & ~bit);
+		}
+
+		// The 64 bit word of brick b. Bit l is the cell with localIndex() l.
+		uint64_t brickBits(const int b) const { return words[b]; }
+
+		void fill(const bool v) {
+			std::fill(words.begin(), words.end(), v ? ~0ull : 0ull);
+		}
+
+		// Calls f(cell, value) for every cell
+		template<typename F>
+		void forEach(const F& f) const {
+			const int nb = numBricks();
+#pragma omp parallel for schedule(static, 64)
+			for (int b = 0; b < nb; b++) {
+				const uint64_t w = words[b];
+				forCellsInBrick(b, [&](const ivec3 cell, const int l) { f(cell, (bool)((w >> l) & 1)); });
+			}
+		}
+
+		// Sets every cell to f(cell, value)
+		template<typename F>
+		void map(const F& f) {
+			const int nb = numBricks();
+#pragma omp parallel for schedule(static, 64)
+			for (int b = 0; b < nb; b++) {
+				const uint64_t w = words[b];
+				uint64_t r = w;
+				forCellsInBrick(b, [&](const ivec3 cell, const int l) {
+					const uint64_t bit = 1ull << l;
+					r = f(cell, (bool)(w & bit)) ? (r | bit) : (r & ~bit);
+					});
+				words[b] = r;
+			}
+		}
+
+		// Number of set cells
+		size_t count() const {
+			// Padding cells of partial bricks are masked out
+			size_t total = 0;
+			const int nb = numBricks();
+#pragma omp parallel
+			{
+				size_t local = 0;
+#pragma omp for schedule(static, 1024)
+				for (int b = 0; b < nb; b++) {
+					uint64_t mask = 0;
+					forCellsInBrick(b, [&](const ivec3 cell, const int l) { mask |= 1ull << l; });
+					local += std::bitset<64>(words[b] & mask).count();
+				}
+#pragma omp critical
+				total += local;
+			}
+			return total;
+		}
+
+		// Trilinear interpolation of the occupancy at pos, clamped to the domain
+		float sample(const vec3 pos) const {
+			vec3 t;
+			const ivec3 c0 = sampleCell(pos, t);
+			const ivec3 c1 = glm::min(c0 + 1, glm::max(dims - 1, ivec3(0)));
+			float v = 0;
+			for (int k = 0; k < 8; k++) {
+				const ivec3 c((k & 1) ? c1.x : c0.x, (k & 2) ? c1.y : c0.y, (k & 4) ? c1.z : c0.z);
+				const float w = ((k & 1) ? t.x : 1 - t.x) * ((k & 2) ? t.y : 1 - t.y) * ((k & 4) ? t.z : 1 - t.z);
+				v += (*this)(c) ? w : 0;
+			}
+			return v;
+		}
+	};
+}
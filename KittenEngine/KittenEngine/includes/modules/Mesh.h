@@ -7,6 +7,8 @@
 #include <filesystem>
 
 #include "KittenAssets.h"
+#include "Rotor.h"
+#include "SpatialSort.h"
 
 namespace Kitten {
 	using namespace std;
@@ -35,13 +37,18 @@ namespace Kitten {
 
 		Mesh();
 		Mesh(Mesh& m);
-		~Mesh();
+		virtual ~Mesh();
 
 		int hashTriangles();
 
 		void setFromLine(vector<vec3>& points);
 		void polygonize();
 		void transform(mat4);
+		// Rotates by q then translates. Normals are only rotated.
+		void transform(Rotor q, vec3 translation = vec3(0));
+		// Reorders vertices and triangles along a space filling curve so nearby geometry is nearby in memory.
+		// Triangles are only reordered within their groups. Virtual so TetMesh also remaps tetIndices through a Mesh*.
+		virtual void spatialSort(SpatialKey type = SpatialKey::Hilbert);
 		void draw();
 		void initGL();
 		void upload();
@@ -72,6 +79,8 @@ namespace Kitten {
 		void flipInverted();
 		void regenSurface();
 		void writeTetsOBJ(string p);
+		// Mesh::spatialSort() that also remaps and reorders tetIndices
+		void spatialSort(SpatialKey type = SpatialKey::Hilbert) override;
 	};
 
 	Mesh* genQuadMesh(int rows = 1, int cols = 1);
@@ -105,7 +105,7 @@ namespace Kitten {
 		}
 
 		KITTEN_FUNC_DECL mat<3, 3, T, defaultp> matrix() {
-			mat3 cm = crossMatrix(q);
+			mat<3, 3, T, defaultp> cm = crossMatrix(q);
 			return abT(q, q) + mat<3, 3, T, defaultp>(w * w) + 2 * w * cm + cm * cm;
 		}
 
@@ -0,0 +1,57 @@
+#pragma once
+// Batched Rotor kernels over structure of arrays data.
+
+#include "Rotor.h"
+
+namespace Kitten {
+	// Rotors stored as one array per component, matching the Rotor layout { x, y, z, w }
+	struct RotorSoA {
+		float* x;
+		float* y;
+		float* z;
+		float* w;
+	};
+
+	// Vectors stored as one array per component
+	struct Vec3SoA {
+		float* x;
+		float* y;
+		float* z;
+	};
+
+	// Selects the kernel width. Auto picks the widest one enabled by the build.
+	enum class RotorBatchWidth {
+		Auto,
+		SSE,
+		AVX
+	};
+
+	// The kernels below split n elements across OpenMP threads.
+	// Outputs may alias their inputs for in place updates. Arrays need no alignment.
+
+	// out[i] = q * v[i]
+	void rotate(const Rotor& q, Vec3SoA v, Vec3SoA out, int n, RotorBatchWidth width = RotorBatchWidth::Auto);
+
+	// out[i] = q[i] * v[i]
+	void rotate(RotorSoA q, Vec3SoA v, Vec3SoA out, int n, RotorBatchWidth width = RotorBatchWidth::Auto);
+
+	// out[i] = a[i] * b[i]
+	void compose(RotorSoA a, RotorSoA b, RotorSoA out, int n, RotorBatchWidth width = RotorBatchWidth::Auto);
+
+	// q[i] = normalize(q[i])
+	void normalize(RotorSoA q, int n, RotorBatchWidth width = RotorBatchWidth::Auto);
+
+	// Integrates world space angular velocities over dt with the exponential map.
+	// q[i] = exp(dt / 2 * omega[i]) * q[i], renormalized.
+	void integrate(RotorSoA q, Vec3SoA omega, float dt, int n, RotorBatchWidth width = RotorBatchWidth::Auto);
+
+	// out[i] = q[i].matrix()
+	void matrix(RotorSoA q, mat3* out, int n, RotorBatchWidth width = RotorBatchWidth::Auto);
+
+	// Applies q * v + t in place to n vectors of 3 floats spaced stride floats apart,
+	// such as a field of an array of structures.
+	void rigidTransform(const Rotor& q, const vec3& t, float* v, size_t stride, int n);
+
+	// Times the scalar Rotor methods against the SSE and AVX kernels on n random rotors
+	void rotorBatchBenchmark(int n = 1 << 20);
+}
@@ -2,7 +2,11 @@
 // Jerry Hsu, 2022
 
 #include <atomic>
+#include <vector>
+#include <random>
+#include <stdexcept>
 #include <glm/glm.hpp>
+#include "SpatialSort.h"
 
 namespace Kitten {
 	using namespace glm;
@@ -11,6 +15,10 @@ namespace Kitten {
 	/// An atomically synchronized hashmap for spatial hashing.
 	/// add() and getNeighbors() cannot be called concurrently. 
 	/// However, they are each thread-safe when not mixed.
+	/// clear() is O(1). Entries are stamped with an epoch and ones from older epochs count as empty.
+	/// Positions are stored with the values so forEachPair() can find each close pair exactly once.
+	/// Alternatively, build() fills the whole map at once from a static set of points,
+	/// after which each neighboring cell is a contiguous range.
 	/// </summary>
 	/// <typeparam name="T"></typeparam>
 	template <typename T>
@@ -20,14 +28,28 @@ namespace Kitten {
 		const float cellSize;
 
 	private:
+		// Keys pack the epoch, the probe order and the cell hash so a slot is claimed with one compare_exchange.
+		// The order is only compared to the probe position, so keeping its low 16 bits is enough.
+		typedef std::atomic<uint64_t> key;
+
+		// Compact mode cell ranges. Slots are in increasing hash order so a lookup stops early.
 		typedef struct {
-			int order;
-			std::atomic<uint32_t> hash;
-		} key;
+			uint32_t hash;
+			uint32_t begin;
+			uint32_t end;
+		} cellRange;
 
 		const float invCellSize;
 		key* keys;
 		T* vals;
+		vec3* poses;
+		uint16_t epoch = 1;
+
+		bool compact = false;
+		int rangeBits = 1;
+		std::vector<cellRange> ranges;
+		std::vector<uint64_t> sortKeys;
+		std::vector<uint32_t> sortIdx;
 
 		ivec3 getCell(vec3 pos) {
 			return glm::ceil(pos * invCellSize);
@@ -40,23 +62,117 @@ namespace Kitten {
 			return hash + (!hash);
 		}
 
-	public:
-		void clear() {
+		uint64_t stamp(uint32_t hash, int order) const {
+			return ((uint64_t)epoch << 48) | ((uint64_t)(uint16_t)order << 32) | hash;
+		}
+
+		bool occupied(uint64_t k) const {
+			return (uint16_t)(k >> 48) == epoch;
+		}
+
+		// Empties every slot regardless of its epoch
+		void wipe() {
+			epoch = 1;
 #pragma omp parallel for schedule(static, 4096)
 			for (long long i = 0; i < (long long)maxSize; i++)
-				keys[i].hash = 0;
+				keys[i] = 0;
+		}
+
+		// The forward half of the 26 neighboring cells. Together with the cell itself, every pair of cells is visited once.
+		inline const static ivec3 halfOffsets[13]{
+			ivec3(1, 0, 0),
+			ivec3(-1, 1, 0), ivec3(0, 1, 0), ivec3(1, 1, 0),
+			ivec3(-1, -1, 1), ivec3(0, -1, 1), ivec3(1, -1, 1),
+			ivec3(-1, 0, 1), ivec3(0, 0, 1), ivec3(1, 0, 1),
+			ivec3(-1, 1, 1), ivec3(0, 1, 1), ivec3(1, 1, 1)
+		};
+
+		// Number of slots that may hold entries
+		size_t numSlots() const {
+			return compact ? sortKeys.size() : maxSize;
+		}
+
+		// Calls f(slot) for every entry in cell c. Entries of other cells sharing its hash are skipped.
+		template<typename F>
+		void forEachInCell(const ivec3 c, const F& f) {
+			const uint32_t hash = getCellHash(c);
+			if (compact) {
+				uint32_t begin, end;
+				if (findRange(rangeKey(hash), begin, end))
+					for (uint32_t i = begin; i < end; i++)
+						if (getCell(poses[i]) == c) f(i);
+				return;
+			}
+
+			// Same probe sequence as add()
+			uint32_t cell = hash % maxSize;
+			uint32_t stride = 1;
+			int order = 0;
+			while (true) {
+				const uint64_t k = keys[cell];
+				if (!occupied(k)) return;
+				if ((uint32_t)k == hash) {
+					if (k == stamp(hash, order) && getCell(poses[cell]) == c) f(cell);
+				}
+				else stride += 2;
+				order++;
+				cell = (cell + stride) % maxSize;
+			}
+		}
+
+		// Calls f(a, b) for every pair between the entry in slot i and a later entry of its cell or an entry of a forward cell
+		template<typename F>
+		void forEachPairOf(const uint32_t i, const float radius2, const F& f) {
+			if (!compact && !occupied(keys[i])) return;
+			const vec3 p = poses[i];
+			const ivec3 c = getCell(p);
+			auto visit = [&](const uint32_t j) {
+				if (length2(poses[j] - p) <= radius2) f(vals[i], vals[j]);
+				};
+			forEachInCell(c, [&](const uint32_t j) { if (j > i) visit(j); });
+			for (int k = 0; k < 13; k++)
+				forEachInCell(c + halfOffsets[k], visit);
+		}
+
+		// Compact mode sorts on a bijective mix of the cell hash, since nearby cells only differ in the low bits.
+		// Zero still maps to zero so the mixed key of a cell is never zero.
+		static uint32_t rangeKey(uint32_t hash) {
+			hash ^= hash >> 16;
+			hash *= 0x85ebca6bu;
+			hash ^= hash >> 13;
+			hash *= 0xc2b2ae35u;
+			return hash ^ (hash >> 16);
+		}
+
+		// The range of vals with this key in compact mode
+		bool findRange(uint32_t hash, uint32_t& begin, uint32_t& end) const {
+			size_t s = hash >> (32 - rangeBits);
+			while (ranges[s].hash && hash > ranges[s].hash) s++;
+			if (ranges[s].hash != hash) return false;
+			begin = ranges[s].begin;
+			end = ranges[s].end;
+			return true;
+		}
+
+	public:
+		// Advances the epoch. The table is only wiped when the epoch wraps around.
+		void clear() {
+			compact = false;
+			if (!++epoch) wipe();
 		}
 
 		SpatialHashmap(const size_t maxCol, const float maxDiameter) :
 			maxSize(2llu << (int)ceil(log2((double)maxCol))), cellSize(maxDiameter), invCellSize(1.f / maxDiameter) {
 			keys = new key[maxSize];
 			vals = new T[maxSize];
-			clear();
+			poses = new vec3[maxSize];
+			wipe();
 		}
 
 		~SpatialHashmap() {
 			delete[] keys;
 			delete[] vals;
+			delete[] poses;
 		}
 
 		void add(vec3 pos, T val) {
@@ -65,20 +181,122 @@ namespace Kitten {
 			uint32_t stride = 1;
 
 			int order = 0;
-			uint32_t expected = 0;
+			uint64_t expected = keys[cell];
 
 			while (true) {
-				if (keys[cell].hash.compare_exchange_strong(expected, hash)) {
-					keys[cell].order = order;
-					vals[cell] = val;
-					break;
+				// Stale slots are claimed by swapping in the stamped key
+				if (!occupied(expected)) {
+					if (keys[cell].compare_exchange_strong(expected, stamp(hash, order))) {
+						vals[cell] = val;
+						poses[cell] = pos;
+						break;
+					}
+					continue;
 				}
 
 				order++;
-				if (expected != hash) stride += 2;
+				if ((uint32_t)expected != hash) stride += 2;
 				cell = (cell + stride) % maxSize;
-				expected = 0;
+				expected = keys[cell];
+			}
+		}
+
+		/// <summary>
+		/// Replaces the contents of the map with n values at the given positions.
+		/// Values are radix sorted by cell hash and each cell hash gets one [begin, end) range in a compact table,
+		/// so neighbor queries scan 27 contiguous ranges instead of following probe chains.
+		/// add() cannot be used again until clear() is called.
+		/// </summary>
+		void build(const vec3* pos, const T* values, const size_t n) {
+			if (n > maxSize) throw std::runtime_error("SpatialHashmap::build() exceeds capacity");
+			compact = true;
+			sortKeys.resize(n);
+			sortIdx.resize(n);
+
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)n; i++) {
+				sortKeys[i] = rangeKey(getCellHash(getCell(pos[i])));
+				sortIdx[i] = (uint32_t)i;
+			}
+			radixSort(sortKeys.data(), sortIdx.data(), n, 32);
+
+			size_t numRanges = 0;
+#pragma omp parallel
+			{
+				size_t local = 0;
+#pragma omp for schedule(static, 4096)
+				for (long long i = 0; i < (long long)n; i++) {
+					vals[i] = values[sortIdx[i]];
+					poses[i] = pos[sortIdx[i]];
+					local += i == 0 || sortKeys[i] != sortKeys[i - 1];
+				}
+#pragma omp critical
+				numRanges += local;
+			}
+
+			// Ranges are placed at the top bits of their hash, or right after the previous range.
+			// Sorted hashes make this linear probing without wrap around. The tail slots absorb the overflow.
+			rangeBits = (int)ceil(log2((double)numRanges + 1)) + 1;
+			ranges.assign(((size_t)1 << rangeBits) + numRanges + 1, cellRange{ 0, 0, 0 });
+			size_t slot = 0;
+			for (size_t i = 0; i < n; i++) {
+				const uint32_t hash = (uint32_t)sortKeys[i];
+				if (i && hash == ranges[slot].hash) {
+					ranges[slot].end++;
+					continue;
+				}
+				if (i) slot++;
+				slot = std::max(slot, (size_t)(hash >> (32 - rangeBits)));
+				ranges[slot] = cellRange{ hash, (uint32_t)i, (uint32_t)i + 1 };
+			}
+		}
+
+		void build(const std::vector<vec3>& pos, const std::vector<T>& values) {
+			build(pos.data(), values.data(), std::min(pos.size(), values.size()));
+		}
+
+		/// <summary>
+		/// Calls f(a, b) once for every unordered pair of values whose positions are within radius of each other.
+		/// radius cannot exceed cellSize. f is called concurrently from multiple threads.
+		/// After build() only the entries are scanned, otherwise the whole table is.
+		/// </summary>
+		template<typename F>
+		void forEachPair(const float radius, const F& f) {
+			if (radius > cellSize) throw std::runtime_error("SpatialHashmap::forEachPair() radius exceeds cell size");
+			const long long n = (long long)numSlots();
+#pragma omp parallel for schedule(dynamic, 4096)
+			for (long long i = 0; i < n; i++)
+				forEachPairOf((uint32_t)i, radius * radius, f);
+		}
+
+		/// <summary>
+		/// Every pair forEachPair() visits. Each block of slots fills its own buffer and the buffers are
+		/// concatenated in block order, so the result does not depend on the thread count.
+		/// Storing the pairs costs extra over forEachPair(), so prefer that when each pair can be handled in place.
+		/// </summary>
+		std::vector<std::pair<T, T>> collectPairs(const float radius) {
+			if (radius > cellSize) throw std::runtime_error("SpatialHashmap::collectPairs() radius exceeds cell size");
+			constexpr long long blockSize = 16384;
+			const long long n = (long long)numSlots();
+			const long long numBlocks = (n + blockSize - 1) / blockSize;
+
+			std::vector<std::vector<std::pair<T, T>>> buffers(numBlocks);
+#pragma omp parallel for schedule(dynamic, 1)
+			for (long long b = 0; b < numBlocks; b++) {
+				const long long end = std::min(n, (b + 1) * blockSize);
+				for (long long i = b * blockSize; i < end; i++)
+					forEachPairOf((uint32_t)i, radius * radius, [&](const T& x, const T& y) { buffers[b].emplace_back(x, y); });
 			}
+
+			std::vector<size_t> offsets(numBlocks + 1, 0);
+			for (long long b = 0; b < numBlocks; b++)
+				offsets[b + 1] = offsets[b] + buffers[b].size();
+
+			std::vector<std::pair<T, T>> pairs(offsets[numBlocks]);
+#pragma omp parallel for schedule(dynamic, 1)
+			for (long long b = 0; b < numBlocks; b++)
+				std::copy(buffers[b].begin(), buffers[b].end(), pairs.begin() + offsets[b]);
+			return pairs;
 		}
 
 		struct neighborhoodIter {
@@ -109,12 +327,20 @@ namespace Kitten {
 			uint32_t hash;
 			uint32_t cell;
 			uint32_t stride;
+			uint32_t rangeEnd;
 			int order;
 			int index;
 
 			neighborhoodIter(SpatialHashmap* map, ivec3 center) : map(map), center(center) {
 				if (!map) return;
 
+				if (map->compact) {
+					index = -1;
+					cell = rangeEnd = 0;
+					++(*this);
+					return;
+				}
+
 				index = order = 0;
 				stride = 1;
 				hash = map->getCellHash(center + offsets[index]);
@@ -134,11 +360,26 @@ namespace Kitten {
 
 			neighborhoodIter& operator++() {
 				if (!map) return *this;
+
+				// Compact mode scans each cell's range in turn
+				if (map->compact) {
+					if (++cell < rangeEnd) return *this;
+					while (++index < 27) {
+						uint32_t begin;
+						if (map->findRange(rangeKey(map->getCellHash(center + offsets[index])), begin, rangeEnd)) {
+							cell = begin;
+							return *this;
+						}
+					}
+					map = nullptr;
+					return *this;
+				}
+
 				do {
 					cell = (cell + stride) % map->maxSize;
 
 					// End of this cell
-					while (map->keys[cell].hash == 0) {
+					while (!map->occupied(map->keys[cell])) {
 						// End of all cells
 						if (++index == 27) {
 							map = nullptr;
@@ -153,8 +394,9 @@ namespace Kitten {
 					}
 					if (!map) break;
 
-					if (map->keys[cell].hash == hash) {
-						if (map->keys[cell].order == order) break;
+					const uint64_t k = map->keys[cell];
+					if ((uint32_t)k == hash) {
+						if (k == map->stamp(hash, order)) break;
 					}
 					else stride += 2;
 
@@ -196,4 +438,96 @@ namespace Kitten {
 			printf("%d %d %d\n", a, b, *itr % 10);
 		}
 	}
+
+	// Times the probe based add() against the sorted build() and their neighbor queries on n random points
+	inline void benchSpatialHashmap(const int n = 1 << 18) {
+		std::mt19937 rng(1);
+		const float extent = cbrt((float)n / 4);	// About 4 points per cell
+		std::uniform_real_distribution<float> dist(0, extent);
+		std::vector<vec3> pos(n);
+		std::vector<int> ids(n);
+		for (int i = 0; i < n; i++) {
+			pos[i] = vec3(dist(rng), dist(rng), dist(rng));
+			ids[i] = i;
+		}
+
+		SpatialHashmap<int> map(n, 1);
+		StopWatch timer;
+		timer.gpuSync = false;
+		printf("spatial hashmap benchmark: n = %d\n", n);
+
+		auto query = [&]() {
+			long long sum = 0;
+#pragma omp parallel
+			{
+				long long local = 0;
+#pragma omp for schedule(static, 4096)
+				for (int i = 0; i < n; i++)
+					for (auto itr = map.getNeighbors(pos[i]); itr != map.end(); ++itr)
+						local += *itr;
+#pragma omp critical
+				sum += local;
+			}
+			return sum;
+			};
+
+		timer.reset();
+		map.clear();
+#pragma omp parallel for schedule(static, 4096)
+		for (int i = 0; i < n; i++)
+			map.add(pos[i], i);
+		timer.time();
+		const double tAdd = timer.deltaTimes.back();
+		timer.reset();
+		const long long probeSum = query();
+		timer.time();
+		const double tProbe = timer.deltaTimes.back();
+
+		timer.reset();
+		map.build(pos, ids);
+		timer.time();
+		const double tBuild = timer.deltaTimes.back();
+		timer.reset();
+		const long long compactSum = query();
+		timer.time();
+		const double tCompact = timer.deltaTimes.back();
+
+		printf("probe   build %8.3f ms  query %8.3f ms\n", 1000 * tAdd, 1000 * tProbe);
+		printf("compact build %8.3f ms  query %8.3f ms  %s\n", 1000 * tBuild, 1000 * tCompact,
+			probeSum == compactSum ? "match" : "MISMATCH");
+
+		// Pairs within half a cell from filtered full neighborhoods against the half stencil
+		const float radius = 0.5f;
+		timer.reset();
+		size_t numFiltered = 0;
+#pragma omp parallel
+		{
+			size_t local = 0;
+#pragma omp for schedule(static, 4096)
+			for (int i = 0; i < n; i++)
+				for (auto itr = map.getNeighbors(pos[i]); itr != map.end(); ++itr)
+					if (*itr > i && length2(pos[*itr] - pos[i]) <= radius * radius) local++;
+#pragma omp critical
+			numFiltered += local;
+		}
+		timer.time();
+		const double tFiltered = timer.deltaTimes.back();
+
+		// Counting through forEachPair() does the same work as the filtered loop above without storing pairs.
+		// The first value of each pair always comes from the slot being scanned, so its counter has one writer.
+		std::vector<int> pairCounts(n, 0);
+		timer.reset();
+		map.forEachPair(radius, [&](const int& a, const int&) { pairCounts[a]++; });
+		timer.time();
+		const double tVisited = timer.deltaTimes.back();
+		size_t numVisited = 0;
+		for (int c : pairCounts) numVisited += c;
+
+		timer.reset();
+		const size_t numPairs = map.collectPairs(radius).size();
+		timer.time();
+		// getNeighbors() visits neighboring cells with colliding hashes twice, so its count can be slightly higher
+		printf("pairs   getNeighbors %8.3f ms (%zu)  forEachPair %8.3f ms (%zu)  collectPairs %8.3f ms (%zu)\n",
+			1000 * tFiltered, numFiltered, 1000 * tVisited, numVisited, 1000 * timer.deltaTimes.back(), numPairs);
+	}
 }
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+// Space filling curve keys and sorting for spatially coherent memory layouts.
+
+#include <vector>
+#include "Common.h"
+#include "Bound.h"
+
+namespace Kitten {
+	enum class SpatialKey {
+		Morton,
+		Hilbert
+	};
+
+	// The cell of pos with bounds split into 2^21 cells per axis, clamped to the bounds
+	inline ivec3 spatialKeyCell(const vec3& pos, const Bound<>& bounds) {
+		constexpr float maxCell = (float)((1 << 21) - 1);
+		const vec3 scale = maxCell / glm::max(bounds.max - bounds.min, vec3(1e-30f));
+		return ivec3(glm::clamp((pos - bounds.min) * scale + 0.5f, vec3(0), vec3(maxCell)));
+	}
+
+	// getMorton64() or getHilbert64() of each position quantized over bounds. Runs in parallel.
+	// Morton keys use BMI2 pdep when available and Hilbert keys run 8 wide with AVX2.
+	void spatialKeys(const vec3* pos, uint64_t* keys, size_t n, const Bound<>& bounds, SpatialKey type = SpatialKey::Hilbert);
+
+	// Stable parallel LSD radix sort of keys with values carried along.
+	// Only the low keyBits bits of the keys are sorted on.
+	void radixSort(uint64_t* keys, uint32_t* values, size_t n, int keyBits = 64);
+
+	// The permutation that sorts pos along the curve. perm[i] is the old index of the i-th position.
+	std::vector<uint32_t> spatialOrder(const std::vector<vec3>& pos, SpatialKey type = SpatialKey::Hilbert);
+
+	// Times key generation and the radix sort against the scalar encoders and std::sort on n random points
+	void spatialSortBenchmark(int n = 1 << 22);
+}
@@ -425,6 +425,404 @@ namespace Kitten {
 					result[N + j + (i * (i - 1)) / 2] = v[i] * v[j];
 			return result;
 		}
+
+		// Index into data of entry (i, j)
+		constexpr KITTEN_FUNC_DECL static int index(const int i, const int j) {
+			return i == j ? i : (i < j ? N + i + (j * (j - 1)) / 2 : N + j + (i * (i - 1)) / 2);
+		}
+
+		constexpr KITTEN_FUNC_DECL T operator()(const int i, const int j) const {
+			return data[index(i, j)];
+		}
+
+		// Factorization and solves. These work in place on data.
+
+		// In place LDL^T factorization without pivoting.
+		// D is stored on the diagonal and the strict lower triangle of L in the off diagonals.
+		// Only stable for SPD or quasi-definite matrices. Nonsingular indefinite matrices such as [[0, 1], [1, 0]]
+		// can hit zero or tiny pivots, so use solve() or inverse() for those.
+		// Returns false on a zero pivot.
+		constexpr KITTEN_FUNC_DECL bool ldlt() {
+			for (int j = 0; j < N; j++) {
+				T d = data[j];
+				for (int k = 0; k < j; k++) {
+					const T l = data[index(j, k)];
+					d -= l * l * data[k];
+				}
+				if (d == 0) return false;
+				data[j] = d;
+
+				const T invD = 1 / d;
+				for (int i = j + 1; i < N; i++) {
+					T v = data[index(i, j)];
+					for (int k = 0; k < j; k++)
+						v -= data[index(i, k)] * data[index(j, k)] * data[k];
+					data[index(i, j)] = v * invD;
+				}
+			}
+			return true;
+		}
+
+		// Solves Ax = b on a matrix that has been through ldlt()
+		constexpr KITTEN_FUNC_DECL vec_type ldltSolve(vec_type b) const {
+			for (int i = 1; i < N; i++)
+				for (int k = 0; k < i; k++)
+					b[i] -= data[index(i, k)] * b[k];
+			for (int i = 0; i < N; i++)
+				b[i] /= data[i];
+			for (int i = N - 2; i >= 0; i--)
+				for (int k = i + 1; k < N; k++)
+					b[i] -= data[index(k, i)] * b[k];
+			return b;
+		}
+
+		// In place Cholesky factorization A = LL^T with L stored in the diagonal and off diagonals.
+		// Returns false if the matrix is not positive definite.
+		constexpr KITTEN_FUNC_DECL bool cholesky() {
+			for (int j = 0; j < N; j++) {
+				T d = data[j];
+				for (int k = 0; k < j; k++) {
+					const T l = data[index(j, k)];
+					d -= l * l;
+				}
+				if (!(d > 0)) return false;
+				d = sqrt(d);
+				data[j] = d;
+
+				const T invD = 1 / d;
+				for (int i = j + 1; i < N; i++) {
+					T v = data[index(i, j)];
+					for (int k = 0; k < j; k++)
+						v -= data[index(i, k)] * data[index(j, k)];
+					data[index(i, j)] = v * invD;
+				}
+			}
+			return true;
+		}
+
+		// Solves Ax = b on a matrix that has been through cholesky()
+		constexpr KITTEN_FUNC_DECL vec_type choleskySolve(vec_type b) const {
+			for (int i = 0; i < N; i++) {
+				for (int k = 0; k < i; k++)
+					b[i] -= data[index(i, k)] * b[k];
+				b[i] /= data[i];
+			}
+			for (int i = N - 1; i >= 0; i--) {
+				for (int k = i + 1; k < N; k++)
+					b[i] -= data[index(k, i)] * b[k];
+				b[i] /= data[i];
+			}
+			return b;
+		}
+
+		// Solves AX = B for the M columns of B in place.
+		// Gaussian elimination with partial pivoting on a dense copy, since symmetric pivoting alone cannot handle indefinite matrices.
+		// Returns false if the matrix is singular.
+		template <int M>
+		constexpr KITTEN_FUNC_DECL bool pivotedSolve(T(&b)[N][M]) const {
+			T a[N][N] = {};
+			for (int i = 0; i < N; i++)
+				for (int j = 0; j < N; j++)
+					a[i][j] = (*this)(i, j);
+
+			for (int k = 0; k < N; k++) {
+				int p = k;
+				for (int i = k + 1; i < N; i++)
+					if (abs(a[i][k]) > abs(a[p][k])) p = i;
+				if (a[p][k] == 0) return false;
+				if (p != k) {
+					for (int j = k; j < N; j++) {
+						const T t = a[k][j]; a[k][j] = a[p][j]; a[p][j] = t;
+					}
+					for (int j = 0; j < M; j++) {
+						const T t = b[k][j]; b[k][j] = b[p][j]; b[p][j] = t;
+					}
+				}
+
+				const T invP = 1 / a[k][k];
+				for (int i = k + 1; i < N; i++) {
+					const T l = a[i][k] * invP;
+					for (int j = k + 1; j < N; j++)
+						a[i][j] -= l * a[k][j];
+					for (int j = 0; j < M; j++)
+						b[i][j] -= l * b[k][j];
+				}
+			}
+
+			for (int i = N - 1; i >= 0; i--) {
+				const T invP = 1 / a[i][i];
+				for (int j = 0; j < M; j++) {
+					T v = b[i][j];
+					for (int k = i + 1; k < N; k++)
+						v -= a[i][k] * b[k][j];
+					b[i][j] = v * invP;
+				}
+			}
+			return true;
+		}
+
+		// Solves Ax = b. Works on indefinite matrices. Returns zero if the matrix is singular.
+		constexpr KITTEN_FUNC_DECL vec_type solve(const vec_type& b) const {
+			if constexpr (N <= 3)
+				return inverse() * b;
+			else {
+				T x[N][1] = {};
+				for (int i = 0; i < N; i++)
+					x[i][0] = b[i];
+				if (!pivotedSolve(x)) return vec_type(0);
+				vec_type r;
+				for (int i = 0; i < N; i++)
+					r[i] = x[i][0];
+				return r;
+			}
+		}
+
+		// The inverse. Works on indefinite matrices. Returns zero if the matrix is singular.
+		// Closed form adjugate for N <= 3, pivotedSolve() otherwise.
+		constexpr KITTEN_FUNC_DECL SymMat<N, T> inverse() const {
+			SymMat<N, T> result(0);
+			if constexpr (N == 1) {
+				if (data[0] != 0) result[0] = 1 / data[0];
+			}
+			else if constexpr (N == 2) {
+				const T det = data[0] * data[1] - data[2] * data[2];
+				if (det == 0) return result;
+				const T invDet = 1 / det;
+				result[0] = data[1] * invDet;
+				result[1] = data[0] * invDet;
+				result[2] = -data[2] * invDet;
+			}
+			else if constexpr (N == 3) {
+				// (0, 1) is data[3], (0, 2) is data[4], (1, 2) is data[5]
+				const T c0 = data[1] * data[2] - data[5] * data[5];
+				const T c1 = data[0] * data[2] - data[4] * data[4];
+				const T c2 = data[0] * data[1] - data[3] * data[3];
+				const T c3 = data[4] * data[5] - data[3] * data[2];
+				const T c4 = data[3] * data[5] - data[4] * data[1];
+				const T c5 = data[3] * data[4] - data[0] * data[5];
+				const T det = data[0] * c0 + data[3] * c3 + data[4] * c4;
+				if (det == 0) return result;
+				const T invDet = 1 / det;
+				result[0] = c0 * invDet;
+				result[1] = c1 * invDet;
+				result[2] = c2 * invDet;
+				result[3] = c3 * invDet;
+				result[4] = c4 * invDet;
+				result[5] = c5 * invDet;
+			}
+			else {
+				T x[N][N] = {};
+				for (int i = 0; i < N; i++)
+					x[i][i] = 1;
+				if (!pivotedSolve(x)) return result;
+				// Average the two triangles so rounding does not favor one side
+				for (int i = 0; i < N; i++)
+					result[i] = x[i][i];
+				for (int i = 1; i < N; i++)
+					for (int j = 0; j < i; j++)
+						result[index(i, j)] = (x[i][j] + x[j][i]) / 2;
+			}
+			return result;
+		}
+
+		// Eigen decomposition A = V diag(vals) V^T with eigenvalues in ascending order.
+		// Closed form for N = 2 and 3 (Eberly, "A Robust Eigensolver for 3x3 Symmetric Matrices"), cyclic Jacobi otherwise.
+		constexpr KITTEN_FUNC_DECL void eigen(vec_type& vals, mat_type& vecs) const {
+			if constexpr (N == 2) {
+				const T mean = (data[0] + data[1]) / 2;
+				const T halfDiff = (data[0] - data[1]) / 2;
+				const T r = sqrt(halfDiff * halfDiff + data[2] * data[2]);
+				const T theta = atan2(data[2], halfDiff) / 2;
+				const T c = cos(theta), s = sin(theta);
+				vals = vec_type(mean - r, mean + r);
+				vecs[0] = vec_type(-s, c);
+				vecs[1] = vec_type(c, s);
+			}
+			else if constexpr (N == 3)
+				eigen3(vals, vecs);
+			else
+				eigenJacobi(vals, vecs);
+		}
+
+		// Projects onto the symmetric positive semi-definite matrices by clamping eigenvalues to at least minEig
+		constexpr KITTEN_FUNC_DECL SymMat<N, T> projectSPD(const T minEig = 0) const {
+			vec_type vals(0);
+			mat_type vecs(1);
+			eigen(vals, vecs);
+			if (vals[0] >= minEig) return *this;
+
+			SymMat<N, T> result(0);
+			for (int k = 0; k < N; k++)
+				result += outer(vecs[k]) * glm::max(vals[k], minEig);
+			return result;
+		}
+
+	private:
+		// Unit vector orthogonal to the rows of A - lambda I
+		constexpr KITTEN_FUNC_DECL static vec_type eigen3Vector0(const SymMat<N, T>& a, const T lambda) {
+			const vec_type r0(a[0] - lambda, a[3], a[4]);
+			const vec_type r1(a[3], a[1] - lambda, a[5]);
+			const vec_type r2(a[4], a[5], a[2] - lambda);
+			const vec_type r0xr1 = cross(r0, r1), r0xr2 = cross(r0, r2), r1xr2 = cross(r1, r2);
+			const T d0 = dot(r0xr1, r0xr1), d1 = dot(r0xr2, r0xr2), d2 = dot(r1xr2, r1xr2);
+			if (d0 >= d1 && d0 >= d2) return r0xr1 / sqrt(d0);
+			if (d1 >= d2) return r0xr2 / sqrt(d1);
+			return r1xr2 / sqrt(d2);
+		}
+
+		// Unit eigenvector for lambda orthogonal to the unit eigenvector w
+		constexpr KITTEN_FUNC_DECL static vec_type eigen3Vector1(const SymMat<N, T>& a, const vec_type& w, const T lambda) {
+			vec_type u(0);
+			if (abs(w.x) > abs(w.y))
+				u = vec_type(-w.z, 0, w.x) / sqrt(w.x * w.x + w.z * w.z);
+			else
+				u = vec_type(0, w.z, -w.y) / sqrt(w.y * w.y + w.z * w.z);
+			const vec_type v = cross(w, u);
+
+			const vec_type au = a * u, av = a * v;
+			T m00 = dot(u, au) - lambda, m01 = dot(u, av), m11 = dot(v, av) - lambda;
+			const T abs00 = abs(m00), abs01 = abs(m01), abs11 = abs(m11);
+			if (abs00 >= abs11) {
+				if (glm::max(abs00, abs01) == 0) return u;
+				if (abs00 >= abs01) {
+					m01 /= m00;
+					m00 = 1 / sqrt(1 + m01 * m01);
+					m01 *= m00;
+				}
+				else {
+					m00 /= m01;
+					m01 = 1 / sqrt(1 + m00 * m00);
+					m00 *= m01;
+				}
+				return m01 * u - m00 * v;
+			}
+			if (glm::max(abs11, abs01) == 0) return u;
+			if (abs11 >= abs01) {
+				m01 /= m11;
+				m11 = 1 / sqrt(1 + m01 * m01);
+				m01 *= m11;
+			}
+			else {
+				m11 /= m01;
+				m01 = 1 / sqrt(1 + m11 * m11);
+				m11 *= m01;
+			}
+			return m11 * u - m01 * v;
+		}
+
+		constexpr KITTEN_FUNC_DECL void eigen3(vec_type& vals, mat_type& vecs) const {
+			// Scale to avoid over and underflow
+			T maxAbs = 0;
+			for (int i = 0; i < DATA_LEN; i++)
+				maxAbs = glm::max(maxAbs, abs(data[i]));
+			vecs = mat_type(1);
+			if (maxAbs == 0) {
+				vals = vec_type(0);
+				return;
+			}
+			const SymMat<N, T> a = *this / maxAbs;
+
+			const T norm = a[3] * a[3] + a[4] * a[4] + a[5] * a[5];
+			if (norm > 0) {
+				const T q = (a[0] + a[1] + a[2]) / 3;
+				const T b00 = a[0] - q, b11 = a[1] - q, b22 = a[2] - q;
+				const T p = sqrt((b00 * b00 + b11 * b11 + b22 * b22 + 2 * norm) / 6);
+				const T c00 = b11 * b22 - a[5] * a[5];
+				const T c01 = a[3] * b22 - a[5] * a[4];
+				const T c02 = a[3] * a[5] - b11 * a[4];
+				const T halfDet = glm::clamp((b00 * c00 - a[3] * c01 + a[4] * c02) / (2 * p * p * p), T(-1), T(1));
+
+				const T angle = acos(halfDet) / 3;
+				const T beta2 = 2 * cos(angle);
+				const T beta0 = 2 * cos(angle + T(2.09439510239319549));
+				const T beta1 = -(beta0 + beta2);
+				vals = vec_type(q + p * beta0, q + p * beta1, q + p * beta2);
+
+				// Start from the eigenvalue furthest from the other two
+				if (halfDet >= 0) {
+					vecs[2] = eigen3Vector0(a, vals[2]);
+					vecs[1] = eigen3Vector1(a, vecs[2], vals[1]);
+					vecs[0] = cross(vecs[1], vecs[2]);
+				}
+				else {
+					vecs[0] = eigen3Vector0(a, vals[0]);
+					vecs[1] = eigen3Vector1(a, vecs[0], vals[1]);
+					vecs[2] = cross(vecs[0], vecs[1]);
+				}
+
+				// The trig form only has half precision near repeated eigenvalues but the vectors are still good.
+				// Rayleigh quotients recover full precision.
+				for (int k = 0; k < 3; k++)
+					vals[k] = dot(vecs[k], a * vecs[k]);
+				sortEigen(vals, vecs);
+			}
+			else {
+				vals = a.diag;
+				sortEigen(vals, vecs);
+			}
+			vals *= maxAbs;
+		}
+
+		constexpr KITTEN_FUNC_DECL void eigenJacobi(vec_type& vals, mat_type& vecs) const {
+			mat_type a = (mat_type)(*this);
+			vecs = mat_type(1);
+
+			T scale = 0;
+			for (int i = 0; i < DATA_LEN; i++)
+				scale += data[i] * data[i];
+			const T eps = sizeof(T) == sizeof(float) ? T(1.1920929e-7) : T(2.220446049250313e-16);
+			const T tol = scale * eps * eps;
+
+			for (int sweep = 0; sweep < 32; sweep++) {
+				T off = 0;
+				for (int q = 1; q < N; q++)
+					for (int p = 0; p < q; p++)
+						off += a[q][p] * a[q][p];
+				if (off <= tol) break;
+
+				for (int q = 1; q < N; q++)
+					for (int p = 0; p < q; p++) {
+						if (a[q][p] == 0) continue;
+						const T theta = (a[q][q] - a[p][p]) / (2 * a[q][p]);
+						const T t = (theta >= 0 ? 1 : -1) / (abs(theta) + sqrt(theta * theta + 1));
+						const T c = 1 / sqrt(t * t + 1);
+						const T s = t * c;
+
+						// A = J^T A J and V = V J
+						for (int k = 0; k < N; k++) {
+							const T akp = a[p][k], akq = a[q][k];
+							a[p][k] = c * akp - s * akq;
+							a[q][k] = s * akp + c * akq;
+						}
+						for (int k = 0; k < N; k++) {
+							const T apk = a[k][p], aqk = a[k][q];
+							a[k][p] = c * apk - s * aqk;
+							a[k][q] = s * apk + c * aqk;
+						}
+						for (int k = 0; k < N; k++) {
+							const T vkp = vecs[p][k], vkq = vecs[q][k];
+							vecs[p][k] = c * vkp - s * vkq;
+							vecs[q][k] = s * vkp + c * vkq;
+						}
+					}
+			}
+
+			for (int i = 0; i < N; i++)
+				vals[i] = a[i][i];
+			sortEigen(vals, vecs);
+		}
+
+		constexpr KITTEN_FUNC_DECL static void sortEigen(vec_type& vals, mat_type& vecs) {
+			for (int i = 1; i < N; i++)
+				for (int j = i; j > 0 && vals[j] < vals[j - 1]; j--) {
+					const T tv = vals[j];
+					vals[j] = vals[j - 1];
+					vals[j - 1] = tv;
+					const vec_type tc = vecs[j];
+					vecs[j] = vecs[j - 1];
+					vecs[j - 1] = tc;
+				}
+		}
 	};
 
 	typedef SymMat<2, float> symmat2;
@@ -0,0 +1,341 @@
+#pragma once
+// Structure of arrays storage for large numbers of small symmetric matrices.
+
+#include <new>
+#include <vector>
+#include "SymMat.h"
+
+namespace Kitten {
+	/// <summary>
+	/// An array of SymMat<N, T> stored as one aligned array per unique entry.
+	/// Entry k of every matrix is contiguous so bulk kernels vectorize across matrices.
+	/// Entries follow the SymMat layout, which for N = 3 is also the hess3 layout.
+	/// The bulk kernels run in parallel.
+	/// </summary>
+	template <int N, typename T>
+	class SymMatArray {
+	public:
+		typedef SymMat<N, T> value_type;
+		typedef glm::vec<N, T, glm::defaultp> vec_type;
+		static constexpr int DATA_LEN = value_type::DATA_LEN;
+		static constexpr size_t ALIGNMENT = 64;
+
+	private:
+		size_t count = 0;
+		size_t stride = 0;	// Capacity of each entry array, padded to a cache line
+		T* buffer = nullptr;
+
+		void allocate(const size_t n) {
+			stride = (n * sizeof(T) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT / sizeof(T);
+			buffer = stride ? (T*)::operator new[](DATA_LEN * stride * sizeof(T), std::align_val_t(ALIGNMENT)) : nullptr;
+		}
+
+		void release() {
+			if (buffer) ::operator delete[](buffer, std::align_val_t(ALIGNMENT));
+			buffer = nullptr;
+			stride = 0;
+		}
+
+	public:
+		/// <summary>
+		/// A view of one matrix in the array that converts to and from the value types
+		/// </summary>
+		struct reference {
+			SymMatArray* arr;
+			size_t i;
+
+			T& operator[](const int k) const { return arr->entry(k)[i]; }
+
+			operator value_type() const {
+				value_type m;
+				for (int k = 0; k < DATA_LEN; k++)
+					m[k] = (*this)[k];
+				return m;
+			}
+
+			template <int M = N, typename U = T, typename std::enable_if<M == 3 && std::is_same<U, float>::value, int>::type = 0>
+			explicit operator hess3() const {
+				hess3 m;
+				for (int k = 0; k < 6; k++)
+					m[k] = (*this)[k];
+				return m;
+			}
+
+			const reference& operator=(const value_type& m) const {
+				for (int k = 0; k < DATA_LEN; k++)
+					(*this)[k] = m[k];
+				return *this;
+			}
+
+			const reference& operator=(const reference& m) const {
+				return *this = (value_type)m;
+			}
+
+			template <int M = N, typename U = T, typename std::enable_if<M == 3 && std::is_same<U, float>::value, int>::type = 0>
+			const reference& operator=(const hess3& m) const {
+				for (int k = 0; k < 6; k++)
+					(*this)[k] = m[k];
+				return *this;
+			}
+
+			const reference& operator+=(const value_type& m) const {
+				for (int k = 0; k < DATA_LEN; k++)
+					(*this)[k] += m[k];
+				return *this;
+			}
+
+			const reference& operator-=(const value_type& m) const {
+				for (int k = 0; k < DATA_LEN; k++)
+					(*this)[k] -= m[k];
+				return *this;
+			}
+		};
+
+		SymMatArray() {}
+
+		SymMatArray(const size_t n) {
+			resize(n);
+		}
+
+		SymMatArray(const size_t n, const value_type& v) {
+			resize(n);
+			fill(v);
+		}
+
+		SymMatArray(const std::vector<value_type>& v) {
+			resize(v.size());
+			gather(v.data());
+		}
+
+		SymMatArray(const SymMatArray& other) {
+			*this = other;
+		}
+
+		SymMatArray(SymMatArray&& other) noexcept {
+			*this = std::move(other);
+		}
+
+		~SymMatArray() {
+			release();
+		}
+
+		SymMatArray& operator=(const SymMatArray& other) {
+			if (this == &other) return *this;
+			resize(other.count);
+			for (int k = 0; k < DATA_LEN; k++)
+				std::copy(other.entry(k), other.entry(k) + count, entry(k));
+			return *this;
+		}
+
+		SymMatArray& operator=(SymMatArray&& other) noexcept {
+			if (this == &other) return *this;
+			release();
+			count = other.count;
+			stride = other.stride;
+			buffer = other.buffer;
+			other.count = other.stride = 0;
+			other.buffer = nullptr;
+			return *this;
+		}
+
+		// Resizes the array. Existing matrices are kept and new ones are uninitialized.
+		void resize(const size_t n) {
+			if (n > stride) {
+				T* old = buffer;
+				const size_t oldStride = stride;
+				allocate(n);
+				if (old) {
+					for (int k = 0; k < DATA_LEN; k++)
+						std::copy(old + k * oldStride, old + k * oldStride + count, entry(k));
+					::operator delete[](old, std::align_val_t(ALIGNMENT));
+				}
+			}
+			count = n;
+		}
+
+		size_t size() const { return count; }
+
+		// The contiguous array holding entry k of every matrix
+		T* entry(const int k) { return buffer + k * stride; }
+		const T* entry(const int k) const { return buffer + k * stride; }
+
+		reference operator[](const size_t i) { return reference{ this, i }; }
+
+		value_type operator[](const size_t i) const {
+			value_type m;
+			for (int k = 0; k < DATA_LEN; k++)
+				m[k] = entry(k)[i];
+			return m;
+		}
+
+		// Copies in size() matrices stored as an array of structures.
+		// Arrays of hess3 can go through gather((const float*)src, 6).
+		void gather(const value_type* src) {
+			gather((const T*)src, sizeof(value_type) / sizeof(T));
+		}
+
+		// Copies out to an array of structures
+		void scatter(value_type* dst) const {
+			scatter((T*)dst, sizeof(value_type) / sizeof(T));
+		}
+
+		// Copies in from any array of structures holding the packed entries every srcStride values
+		void gather(const T* src, const size_t srcStride) {
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)count; i++)
+				for (int k = 0; k < DATA_LEN; k++)
+					entry(k)[i] = src[i * srcStride + k];
+		}
+
+		// Copies out to any array of structures holding the packed entries every dstStride values
+		void scatter(T* dst, const size_t dstStride) const {
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)count; i++)
+				for (int k = 0; k < DATA_LEN; k++)
+					dst[i * dstStride + k] = entry(k)[i];
+		}
+
+		void fill(const value_type& v) {
+			for (int k = 0; k < DATA_LEN; k++) {
+				T* __restrict a = entry(k);
+				const T vk = v[k];
+#pragma omp parallel for schedule(static, 4096)
+				for (long long i = 0; i < (long long)count; i++)
+					a[i] = vk;
+			}
+		}
+
+		// this *= s
+		void scale(const T s) {
+			for (int k = 0; k < DATA_LEN; k++) {
+				T* __restrict a = entry(k);
+#pragma omp parallel for schedule(static, 4096)
+				for (long long i = 0; i < (long long)count; i++)
+					a[i] *= s;
+			}
+		}
+
+		// this += s * x
+		void axpy(const T s, const SymMatArray& x) {
+			for (int k = 0; k < DATA_LEN; k++) {
+				T* __restrict a = entry(k);
+				const T* __restrict b = x.entry(k);
+#pragma omp parallel for schedule(static, 4096)
+				for (long long i = 0; i < (long long)count; i++)
+					a[i] += s * b[i];
+			}
+		}
+
+		// Adds d to every diagonal
+		void addDiagonal(const T d) {
+			for (int k = 0; k < N; k++) {
+				T* __restrict a = entry(k);
+#pragma omp parallel for schedule(static, 4096)
+				for (long long i = 0; i < (long long)count; i++)
+					a[i] += d;
+			}
+		}
+
+		// y[i] = this[i] * x[i]
+		void multiply(const vec_type* __restrict x, vec_type* __restrict y) const {
+			const T* a[DATA_LEN];
+			for (int k = 0; k < DATA_LEN; k++)
+				a[k] = entry(k);
+
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)count; i++) {
+				const vec_type v = x[i];
+				vec_type r(0);
+				for (int c = 0; c < N; c++)
+					for (int j = 0; j < N; j++)
+						r[j] += a[value_type::index(j, c)][i] * v[c];
+				y[i] = r;
+			}
+		}
+
+		// Inverts every matrix in place. Singular matrices become zero.
+		// N = 2 and 3 use the adjugate without branches. Larger N go through SymMat::inverse().
+		void invert() {
+			if constexpr (N == 2) {
+				T* __restrict a0 = entry(0), * __restrict a1 = entry(1), * __restrict a2 = entry(2);
+#pragma omp parallel for schedule(static, 4096)
+				for (long long i = 0; i < (long long)count; i++) {
+					const T det = a0[i] * a1[i] - a2[i] * a2[i];
+					const T invDet = det != 0 ? 1 / det : 0;
+					const T t = a0[i];
+					a0[i] = a1[i] * invDet;
+					a1[i] = t * invDet;
+					a2[i] = -a2[i] * invDet;
+				}
+			}
+			else if constexpr (N == 3) {
+				T* __restrict a0 = entry(0), * __restrict a1 = entry(1), * __restrict a2 = entry(2);
+				T* __restrict a3 = entry(3), * __restrict a4 = entry(4), * __restrict a5 = entry(5);
+#pragma omp parallel for schedule(static, 4096)
+				for (long long i = 0; i < (long long)count; i++) {
+					// (0, 1) is a3, (0, 2) is a4, (1, 2) is a5
+					const T c0 = a1[i] * a2[i] - a5[i] * a5[i];
+					const T c1 = a0[i] * a2[i] - a4[i] * a4[i];
+					const T c2 = a0[i] * a1[i] - a3[i] * a3[i];
+					const T c3 = a4[i] * a5[i] - a3[i] * a2[i];
+					const T c4 = a3[i] * a5[i] - a4[i] * a1[i];
+					const T c5 = a3[i] * a4[i] - a0[i] * a5[i];
+					const T det = a0[i] * c0 + a3[i] * c3 + a4[i] * c4;
+					const T invDet = det != 0 ? 1 / det : 0;
+					a0[i] = c0 * invDet;
+					a1[i] = c1 * invDet;
+					a2[i] = c2 * invDet;
+					a3[i] = c3 * invDet;
+					a4[i] = c4 * invDet;
+					a5[i] = c5 * invDet;
+				}
+			}
+			else {
+#pragma omp parallel for schedule(static, 1024)
+				for (long long i = 0; i < (long long)count; i++)
+					(*this)[i] = ((const SymMatArray&)*this)[i].inverse();
+			}
+		}
+
+		// Clamps the eigenvalues of every matrix to at least minEig.
+		// A vectorized Cholesky pass first finds the matrices that are already fine
+		// so only the rest go through the eigen decomposition.
+		void projectSPD(const T minEig = 0) {
+			std::vector<unsigned char> ok(count);
+			unsigned char* __restrict okPtr = ok.data();
+			const T* a[DATA_LEN];
+			for (int k = 0; k < DATA_LEN; k++)
+				a[k] = entry(k);
+
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)count; i++) {
+				// Cholesky of A - minEig I without the square roots. Pivots must stay positive.
+				T l[DATA_LEN] = {};
+				bool pd = true;
+				for (int j = 0; j < N; j++) {
+					T d = a[j][i] - minEig;
+					for (int k = 0; k < j; k++)
+						d -= l[value_type::index(j, k)] * l[value_type::index(j, k)] * l[k];
+					pd = pd && d > 0;
+					l[j] = d;
+					const T invD = d > 0 ? 1 / d : 0;
+					for (int r = j + 1; r < N; r++) {
+						T v = a[value_type::index(r, j)][i];
+						for (int k = 0; k < j; k++)
+							v -= l[value_type::index(r, k)] * l[value_type::index(j, k)] * l[k];
+						l[value_type::index(r, j)] = v * invD;
+					}
+				}
+				okPtr[i] = pd;
+			}
+
+#pragma omp parallel for schedule(dynamic, 1024)
+			for (long long i = 0; i < (long long)count; i++)
+				if (!okPtr[i])
+					(*this)[i] = ((const SymMatArray&)*this)[i].projectSPD(minEig);
+		}
+	};
+
+	typedef SymMatArray<3, float> symmat3Array;
+	typedef SymMatArray<3, double> symdmat3Array;
+}
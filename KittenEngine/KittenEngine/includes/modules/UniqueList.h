@@ -2,29 +2,88 @@
 // Jerry Hsu, 2022
 
 #include <atomic>
+#include <stdexcept>
 #include <stdio.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 128 bit compare and swap for UniqueList. MSVC has it on x64 and ARM64.
+// GCC and Clang only inline it with -mcx16, otherwise __int128 atomics need libatomic, so those builds fall back.
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))) || defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+#define KITTEN_HAS_CAS128 1
+#else
+#define KITTEN_HAS_CAS128 0
+#endif
 
 namespace Kitten {
+	/// <summary>
+	/// A concurrent set of 64 bit keys that keeps the first value added for each key in insertion order.
+	/// clear() is O(1). Each entry's stamp holds the epoch it was added in and its index into data,
+	/// and entries from older epochs count as empty.
+	/// With KITTEN_HAS_CAS128, add() is lock-free since the key and stamp are claimed together with a 128 bit compare and swap.
+	/// Without it, the stamp is claimed alone and adders probing that entry wait until its key is written.
+	/// </summary>
 	template <typename T>
 	class UniqueList {
 	private:
 		std::atomic<size_t> count;
 
-		typedef struct {
+		typedef struct alignas(16) {
 			std::atomic<uint64_t> key;
-			size_t index;
+			std::atomic<uint64_t> stamp;
 		} entry;
 
+		// Index of an entry claimed by add() whose value (or without KITTEN_HAS_CAS128, key) is not yet written
+		static constexpr uint64_t PENDING = 0xFFFFFFFFllu;
+
 		const size_t tableSize;
 		entry* table;
 		T* data;
+		uint32_t epoch = 1;
+
+		bool stale(uint64_t s) const {
+			return (uint32_t)(s >> 32) != epoch;
+		}
+
+#if KITTEN_HAS_CAS128
+		// Atomically replaces e with {key, stamp} if it still holds {expKey, expStamp}.
+		// On failure expKey and expStamp are updated to the current contents, like compare_exchange_strong.
+		static bool claim(entry& e, uint64_t& expKey, uint64_t& expStamp, const uint64_t key, const uint64_t stamp) {
+#ifdef _MSC_VER
+			long long expected[2] = { (long long)expKey, (long long)expStamp };
+			const bool swapped = _InterlockedCompareExchange128((volatile long long*)&e, (long long)stamp, (long long)key, expected);
+			expKey = (uint64_t)expected[0];
+			expStamp = (uint64_t)expected[1];
+			return swapped;
+#else
+			const unsigned __int128 expected = ((unsigned __int128)expStamp << 64) | expKey;
+			const unsigned __int128 desired = ((unsigned __int128)stamp << 64) | key;
+			const unsigned __int128 old = __sync_val_compare_and_swap((unsigned __int128*)&e, expected, desired);
+			expKey = (uint64_t)old;
+			expStamp = (uint64_t)(old >> 64);
+			return old == expected;
+#endif
+		}
+#endif
+
+		// Empties every entry regardless of its epoch
+		void wipe() {
+			epoch = 1;
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)tableSize; i++)
+				table[i].stamp = 0;
+		}
 
 	public:
 		UniqueList(const size_t capacity) :
 			tableSize(2llu << (int)ceil(log2((double)capacity))) {
+			if (capacity >= PENDING)
+				throw std::runtime_error("UniqueList capacity must fit in 32 bits");
 			data = new T[capacity];
 			table = new entry[tableSize];
-			clear();
+			count = 0;
+			wipe();
 		}
 
 		~UniqueList() {
@@ -33,16 +92,13 @@ namespace Kitten {
 		}
 
 		uint64_t scramble(uint64_t x) {
-			uint64_t a = (x + 11 * (x >> 32)) ^ 0x9e3779b9llu;
-			if (a == 0xFFFFFFFFllu) return (0xFFFFFFFFllu + 11 * (0xFFFFFFFFllu >> 32)) ^ 0x9e3779b9llu;
-			return a;
+			return (x + 11 * (x >> 32)) ^ 0x9e3779b9llu;
 		}
 
+		// Advances the epoch. The table is only wiped when the epoch wraps around.
 		void clear() {
 			count = 0;
-#pragma omp parallel for schedule(static, 4096)
-			for (long long i = 0; i < (long long)tableSize; i++)
-				table[i].key = 0xFFFFFFFFllu;
+			if (!++epoch) wipe();
 		}
 
 		bool add(uint64_t key, T val) {
@@ -50,39 +106,56 @@ namespace Kitten {
 			uint64_t cell = key % tableSize;
 			uint64_t stride = 1;
 
-			uint64_t expected = 0xFFFFFFFFllu;
+			const uint64_t stamp = (uint64_t)epoch << 32;
 
 			while (true) {
-				if (table[cell].key.compare_exchange_strong(expected, key)) {
+#if KITTEN_HAS_CAS128
+				// Stale entries are claimed with the key in place and the index pending.
+				// A failed claim leaves the current contents in k and s so no one waits on a pending entry.
+				uint64_t s = table[cell].stamp;
+				uint64_t k = table[cell].key;
+				while (stale(s))
+					if (claim(table[cell], k, s, key, stamp | PENDING)) {
+						size_t n = count.fetch_add(1);
+						data[n] = val;
+						table[cell].stamp = stamp | n;
+						return true;
+					}
+#else
+				// Stale entries are claimed as pending, then published once the key is in place
+				uint64_t s = table[cell].stamp;
+				if (stale(s) && table[cell].stamp.compare_exchange_strong(s, stamp | PENDING)) {
+					table[cell].key = key;
 					size_t n = count.fetch_add(1);
-					table[cell].index = n;
 					data[n] = val;
+					table[cell].stamp = stamp | n;
 					return true;
 				}
-				if (expected == key)
+				while ((s & PENDING) == PENDING) s = table[cell].stamp;
+				const uint64_t k = table[cell].key;
+#endif
+				if (k == key)
 					return false;
 
 				cell = (cell + (stride++)) % tableSize;
-				expected = 0xFFFFFFFFllu;
 			}
 		}
 
+		// Returns nullptr if the key is absent or its add() has not finished
 		T* find(uint64_t key) {
 			key = scramble(key);
 			uint64_t cell = key % tableSize;
 			uint64_t stride = 1;
 
-			uint64_t expected = 0;
-
 			while (true) {
-				size_t v = table[cell].key;
-				if (v == key)
-					return &data[table[cell].index];
-				else if (v == 0xFFFFFFFFllu)
+				const uint64_t s = table[cell].stamp;
+				if (stale(s))
 					return nullptr;
+				// Pending entries are skipped since their key or value may not be written yet
+				if ((s & PENDING) != PENDING && table[cell].key == key)
+					return &data[s & PENDING];
 
 				cell = (cell + (stride++)) % tableSize;
-				expected = 0xFFFFFFFFllu;
 			}
 		}
 
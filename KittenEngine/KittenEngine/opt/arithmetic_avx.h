@@ -0,0 +1,461 @@
+/*
+ *      AVX2/AVX-512 implementation of vector operations with runtime dispatch.
+ *
+ * Every kernel is compiled for AVX2+FMA and AVX-512F and the widest one the
+ * CPU supports is picked through CPUID on first use, falling back to plain
+ * loops otherwise. Unlike the SSE backends, any n and any alignment are
+ * accepted so no rounding out of the variables is needed.
+ *
+ * Vectors of at least LBFGS_OMP_THRESHOLD elements are split into fixed
+ * blocks of LBFGS_OMP_BLOCK elements and processed with OpenMP. Reductions
+ * sum the block partials in order so results do not depend on the number
+ * of threads.
+ *
+ * Define LBFGS_ARITHMETIC_KERNELS_ONLY to only get the kernels and the
+ * dispatch tables without the vec*() interface used by lbfgs.c.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <memory.h>
+
+#if     defined(_MSC_VER)
+#include <malloc.h>
+#include <intrin.h>
+#endif/*_MSC_VER*/
+
+#include <immintrin.h>
+
+#if     defined(_MSC_VER) && !defined(__clang__)
+/* MSVC emits any intrinsic regardless of /arch */
+#define AVX2_TARGET
+#define AVX512_TARGET
+#else
+#define AVX2_TARGET     __attribute__((target("avx2,fma")))
+#define AVX512_TARGET   __attribute__((target("avx512f")))
+#endif
+
+#ifndef LBFGS_OMP_THRESHOLD
+#define LBFGS_OMP_THRESHOLD (1 << 18)
+#endif/*LBFGS_OMP_THRESHOLD*/
+
+#ifndef LBFGS_OMP_BLOCK
+#define LBFGS_OMP_BLOCK     (1 << 15)
+#endif/*LBFGS_OMP_BLOCK*/
+
+#define LBFGS_VEC_ALIGN     64
+
+enum {
+    LBFGS_ARITHMETIC_ANSI = 0,
+    LBFGS_ARITHMETIC_AVX2,
+    LBFGS_ARITHMETIC_AVX512,
+};
+
+typedef struct {
+    const char *name;
+    void (*ncpy)(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n);
+    void (*add)(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const lbfgsfloatval_t c, const int n);
+    void (*diff)(lbfgsfloatval_t *z, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n);
+    void (*scale)(lbfgsfloatval_t *y, const lbfgsfloatval_t c, const int n);
+    void (*mul)(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n);
+    lbfgsfloatval_t (*dot)(const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n);
+} vecops_t;
+
+/*
+ * Precision dependent intrinsics. W is the number of lanes.
+ */
+#if     LBFGS_FLOAT == 64
+#define AVX2_T          __m256d
+#define AVX2_W          4
+#define AVX2_SET1       _mm256_set1_pd
+#define AVX2_ZERO       _mm256_setzero_pd
+#define AVX2_LOAD       _mm256_loadu_pd
+#define AVX2_STORE      _mm256_storeu_pd
+#define AVX2_ADD        _mm256_add_pd
+#define AVX2_SUB        _mm256_sub_pd
+#define AVX2_MUL        _mm256_mul_pd
+#define AVX2_FMA        _mm256_fmadd_pd
+#define AVX512_T        __m512d
+#define AVX512_W        8
+#define AVX512_SET1     _mm512_set1_pd
+#define AVX512_ZERO     _mm512_setzero_pd
+#define AVX512_LOAD     _mm512_loadu_pd
+#define AVX512_STORE    _mm512_storeu_pd
+#define AVX512_ADD      _mm512_add_pd
+#define AVX512_SUB      _mm512_sub_pd
+#define AVX512_MUL      _mm512_mul_pd
+#define AVX512_FMA      _mm512_fmadd_pd
+#else
+#define AVX2_T          __m256
+#define AVX2_W          8
+#define AVX2_SET1       _mm256_set1_ps
+#define AVX2_ZERO       _mm256_setzero_ps
+#define AVX2_LOAD       _mm256_loadu_ps
+#define AVX2_STORE      _mm256_storeu_ps
+#define AVX2_ADD        _mm256_add_ps
+#define AVX2_SUB        _mm256_sub_ps
+#define AVX2_MUL        _mm256_mul_ps
+#define AVX2_FMA        _mm256_fmadd_ps
+#define AVX512_T        __m512
+#define AVX512_W        16
+#define AVX512_SET1     _mm512_set1_ps
+#define AVX512_ZERO     _mm512_setzero_ps
+#define AVX512_LOAD     _mm512_loadu_ps
+#define AVX512_STORE    _mm512_storeu_ps
+#define AVX512_ADD      _mm512_add_ps
+#define AVX512_SUB      _mm512_sub_ps
+#define AVX512_MUL      _mm512_mul_ps
+#define AVX512_FMA      _mm512_fmadd_ps
+#endif/*LBFGS_FLOAT == 64*/
+
+/*
+ * Plain loops. Used for the tails and on CPUs without AVX2.
+ */
+inline static void ansi_vecncpy(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) y[i] = -x[i];
+}
+
+inline static void ansi_vecadd(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const lbfgsfloatval_t c, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) y[i] += c * x[i];
+}
+
+inline static void ansi_vecdiff(lbfgsfloatval_t *z, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) z[i] = x[i] - y[i];
+}
+
+inline static void ansi_vecscale(lbfgsfloatval_t *y, const lbfgsfloatval_t c, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) y[i] *= c;
+}
+
+inline static void ansi_vecmul(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) y[i] *= x[i];
+}
+
+inline static lbfgsfloatval_t ansi_vecdot(const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n)
+{
+    int i;
+    lbfgsfloatval_t s = 0.;
+    for (i = 0;i < n;++i) s += x[i] * y[i];
+    return s;
+}
+
+/*
+ * Defines the kernels of one instruction set. Main loops are unrolled twice
+ * and dot products keep two accumulators to hide the FMA latency.
+ */
+#define LBFGS_DEFINE_KERNELS(ISA) \
+ISA##_TARGET static void ISA##_vecncpy(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n) \
+{ \
+    int i; \
+    const ISA##_T Z = ISA##_ZERO(); \
+    for (i = 0;i + ISA##_W <= n;i += ISA##_W) \
+        ISA##_STORE(y+i, ISA##_SUB(Z, ISA##_LOAD(x+i))); \
+    ansi_vecncpy(y+i, x+i, n-i); \
+} \
+\
+ISA##_TARGET static void ISA##_vecadd(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const lbfgsfloatval_t c, const int n) \
+{ \
+    int i; \
+    const ISA##_T C = ISA##_SET1(c); \
+    for (i = 0;i + 2*ISA##_W <= n;i += 2*ISA##_W) { \
+        ISA##_STORE(y+i        , ISA##_FMA(ISA##_LOAD(x+i        ), C, ISA##_LOAD(y+i        ))); \
+        ISA##_STORE(y+i+ISA##_W, ISA##_FMA(ISA##_LOAD(x+i+ISA##_W), C, ISA##_LOAD(y+i+ISA##_W))); \
+    } \
+    ansi_vecadd(y+i, x+i, c, n-i); \
+} \
+\
+ISA##_TARGET static void ISA##_vecdiff(lbfgsfloatval_t *z, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n) \
+{ \
+    int i; \
+    for (i = 0;i + 2*ISA##_W <= n;i += 2*ISA##_W) { \
+        ISA##_STORE(z+i        , ISA##_SUB(ISA##_LOAD(x+i        ), ISA##_LOAD(y+i        ))); \
+        ISA##_STORE(z+i+ISA##_W, ISA##_SUB(ISA##_LOAD(x+i+ISA##_W), ISA##_LOAD(y+i+ISA##_W))); \
+    } \
+    ansi_vecdiff(z+i, x+i, y+i, n-i); \
+} \
+\
+ISA##_TARGET static void ISA##_vecscale(lbfgsfloatval_t *y, const lbfgsfloatval_t c, const int n) \
+{ \
+    int i; \
+    const ISA##_T C = ISA##_SET1(c); \
+    for (i = 0;i + ISA##_W <= n;i += ISA##_W) \
+        ISA##_STORE(y+i, ISA##_MUL(ISA##_LOAD(y+i), C)); \
+    ansi_vecscale(y+i, c, n-i); \
+} \
+\
+ISA##_TARGET static void ISA##_vecmul(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n) \
+{ \
+    int i; \
+    for (i = 0;i + ISA##_W <= n;i += ISA##_W) \
+        ISA##_STORE(y+i, ISA##_MUL(ISA##_LOAD(y+i), ISA##_LOAD(x+i))); \
+    ansi_vecmul(y+i, x+i, n-i); \
+} \
+\
+ISA##_TARGET static lbfgsfloatval_t ISA##_vecdot(const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n) \
+{ \
+    int i, k; \
+    lbfgsfloatval_t lanes[ISA##_W], s; \
+    ISA##_T S0 = ISA##_ZERO(); \
+    ISA##_T S1 = ISA##_ZERO(); \
+    for (i = 0;i + 2*ISA##_W <= n;i += 2*ISA##_W) { \
+        S0 = ISA##_FMA(ISA##_LOAD(x+i        ), ISA##_LOAD(y+i        ), S0); \
+        S1 = ISA##_FMA(ISA##_LOAD(x+i+ISA##_W), ISA##_LOAD(y+i+ISA##_W), S1); \
+    } \
+    ISA##_STORE(lanes, ISA##_ADD(S0, S1)); \
+    s = ansi_vecdot(x+i, y+i, n-i); \
+    for (k = 0;k < ISA##_W;++k) s += lanes[k]; \
+    return s; \
+}
+
+LBFGS_DEFINE_KERNELS(AVX2)
+LBFGS_DEFINE_KERNELS(AVX512)
+
+/*
+ * Dispatch tables indexed by LBFGS_ARITHMETIC_*.
+ */
+static const vecops_t vecops_table[3] = {
+    { "ansi", ansi_vecncpy, ansi_vecadd, ansi_vecdiff, ansi_vecscale, ansi_vecmul, ansi_vecdot },
+    { "avx2", AVX2_vecncpy, AVX2_vecadd, AVX2_vecdiff, AVX2_vecscale, AVX2_vecmul, AVX2_vecdot },
+    { "avx512", AVX512_vecncpy, AVX512_vecadd, AVX512_vecdiff, AVX512_vecscale, AVX512_vecmul, AVX512_vecdot },
+};
+
+/* The widest instruction set supported by both the CPU and the OS */
+static int vecops_cpu_level(void)
+{
+#if     defined(_MSC_VER) && !defined(__clang__)
+    int r[4];
+    int fma, level = LBFGS_ARITHMETIC_ANSI;
+    unsigned long long xcr0;
+
+    __cpuid(r, 0);
+    if (r[0] < 7) return level;
+
+    __cpuid(r, 1);
+    fma = (r[2] >> 12) & 1;
+    if (!((r[2] >> 27) & 1)) return level;     /* OSXSAVE */
+
+    /* The OS must save the YMM (and ZMM) state */
+    xcr0 = _xgetbv(0);
+    if ((xcr0 & 0x06) != 0x06) return level;
+
+    __cpuidex(r, 7, 0);
+    if (fma && ((r[1] >> 5) & 1)) level = LBFGS_ARITHMETIC_AVX2;
+    if (level && ((r[1] >> 16) & 1) && (xcr0 & 0xe6) == 0xe6) level = LBFGS_ARITHMETIC_AVX512;
+    return level;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return LBFGS_ARITHMETIC_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return LBFGS_ARITHMETIC_AVX2;
+    return LBFGS_ARITHMETIC_ANSI;
+#endif
+}
+
+/* The kernels of level, clamped to what the CPU supports */
+inline static const vecops_t* vecops_select(int level)
+{
+    static int cpu = -1;
+    if (cpu < 0) cpu = vecops_cpu_level();
+    return &vecops_table[level < cpu ? level : cpu];
+}
+
+inline static const vecops_t* vecops_get(void)
+{
+    static const vecops_t *ops = NULL;
+    if (ops == NULL) ops = vecops_select(LBFGS_ARITHMETIC_AVX512);
+    return ops;
+}
+
+/*
+ * OpenMP variants. Each block is handed to the selected kernel.
+ */
+#define LBFGS_BLOCK_SIZE(n, i) ((n) - (i) < LBFGS_OMP_BLOCK ? (n) - (i) : LBFGS_OMP_BLOCK)
+
+inline static void par_vecncpy(const vecops_t *ops, lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    int i;
+    if (n < LBFGS_OMP_THRESHOLD) {
+        ops->ncpy(y, x, n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0;i < n;i += LBFGS_OMP_BLOCK)
+        ops->ncpy(y+i, x+i, LBFGS_BLOCK_SIZE(n, i));
+}
+
+inline static void par_vecadd(const vecops_t *ops, lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const lbfgsfloatval_t c, const int n)
+{
+    int i;
+    if (n < LBFGS_OMP_THRESHOLD) {
+        ops->add(y, x, c, n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0;i < n;i += LBFGS_OMP_BLOCK)
+        ops->add(y+i, x+i, c, LBFGS_BLOCK_SIZE(n, i));
+}
+
+inline static void par_vecdiff(const vecops_t *ops, lbfgsfloatval_t *z, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n)
+{
+    int i;
+    if (n < LBFGS_OMP_THRESHOLD) {
+        ops->diff(z, x, y, n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0;i < n;i += LBFGS_OMP_BLOCK)
+        ops->diff(z+i, x+i, y+i, LBFGS_BLOCK_SIZE(n, i));
+}
+
+inline static void par_vecscale(const vecops_t *ops, lbfgsfloatval_t *y, const lbfgsfloatval_t c, const int n)
+{
+    int i;
+    if (n < LBFGS_OMP_THRESHOLD) {
+        ops->scale(y, c, n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0;i < n;i += LBFGS_OMP_BLOCK)
+        ops->scale(y+i, c, LBFGS_BLOCK_SIZE(n, i));
+}
+
+inline static void par_vecmul(const vecops_t *ops, lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    int i;
+    if (n < LBFGS_OMP_THRESHOLD) {
+        ops->mul(y, x, n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0;i < n;i += LBFGS_OMP_BLOCK)
+        ops->mul(y+i, x+i, LBFGS_BLOCK_SIZE(n, i));
+}
+
+inline static void par_veccpy(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    int i;
+    if (n < LBFGS_OMP_THRESHOLD) {
+        memcpy(y, x, sizeof(lbfgsfloatval_t) * n);
+        return;
+    }
+#pragma omp parallel for schedule(static)
+    for (i = 0;i < n;i += LBFGS_OMP_BLOCK)
+        memcpy(y+i, x+i, sizeof(lbfgsfloatval_t) * LBFGS_BLOCK_SIZE(n, i));
+}
+
+inline static lbfgsfloatval_t par_vecdot(const vecops_t *ops, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n)
+{
+    int b;
+    lbfgsfloatval_t s = 0., *partial;
+    const int nb = (n + LBFGS_OMP_BLOCK - 1) / LBFGS_OMP_BLOCK;
+
+    if (n < LBFGS_OMP_THRESHOLD) return ops->dot(x, y, n);
+
+    partial = (lbfgsfloatval_t*)malloc(sizeof(lbfgsfloatval_t) * nb);
+#pragma omp parallel for schedule(static)
+    for (b = 0;b < nb;++b) {
+        const int i = b * LBFGS_OMP_BLOCK;
+        partial[b] = ops->dot(x+i, y+i, LBFGS_BLOCK_SIZE(n, i));
+    }
+    for (b = 0;b < nb;++b) s += partial[b];
+    free(partial);
+    return s;
+}
+
+#ifndef LBFGS_ARITHMETIC_KERNELS_ONLY
+
+#if     LBFGS_FLOAT == 32 && LBFGS_IEEE_FLOAT
+#define fsigndiff(x, y) (((*(uint32_t*)(x)) ^ (*(uint32_t*)(y))) & 0x80000000U)
+#else
+#define fsigndiff(x, y) (*(x) * (*(y) / fabs(*(y))) < 0.)
+#endif/*LBFGS_IEEE_FLOAT*/
+
+inline static void* vecalloc(size_t size)
+{
+#if     defined(_MSC_VER)
+    void *memblock = _aligned_malloc(size, LBFGS_VEC_ALIGN);
+#else
+    void *memblock = NULL, *p = NULL;
+    if (posix_memalign(&p, LBFGS_VEC_ALIGN, size) == 0) {
+        memblock = p;
+    }
+#endif
+    if (memblock != NULL) {
+        memset(memblock, 0, size);
+    }
+    return memblock;
+}
+
+inline static void vecfree(void *memblock)
+{
+#ifdef	_MSC_VER
+    _aligned_free(memblock);
+#else
+    free(memblock);
+#endif
+}
+
+inline static void vecset(lbfgsfloatval_t *x, const lbfgsfloatval_t c, const int n)
+{
+    int i;
+    for (i = 0;i < n;++i) x[i] = c;
+}
+
+inline static void veccpy(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    par_veccpy(y, x, n);
+}
+
+inline static void vecncpy(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    par_vecncpy(vecops_get(), y, x, n);
+}
+
+inline static void vecadd(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const lbfgsfloatval_t c, const int n)
+{
+    par_vecadd(vecops_get(), y, x, c, n);
+}
+
+inline static void vecdiff(lbfgsfloatval_t *z, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n)
+{
+    par_vecdiff(vecops_get(), z, x, y, n);
+}
+
+inline static void vecscale(lbfgsfloatval_t *y, const lbfgsfloatval_t c, const int n)
+{
+    par_vecscale(vecops_get(), y, c, n);
+}
+
+inline static void vecmul(lbfgsfloatval_t *y, const lbfgsfloatval_t *x, const int n)
+{
+    par_vecmul(vecops_get(), y, x, n);
+}
+
+inline static void vecdot(lbfgsfloatval_t* s, const lbfgsfloatval_t *x, const lbfgsfloatval_t *y, const int n)
+{
+    *s = par_vecdot(vecops_get(), x, y, n);
+}
+
+inline static void vec2norm(lbfgsfloatval_t* s, const lbfgsfloatval_t *x, const int n)
+{
+    vecdot(s, x, x, n);
+    *s = (lbfgsfloatval_t)sqrt(*s);
+}
+
+inline static void vec2norminv(lbfgsfloatval_t* s, const lbfgsfloatval_t *x, const int n)
+{
+    vec2norm(s, x, n);
+    *s = (lbfgsfloatval_t)(1.0 / *s);
+}
+
+#endif/*LBFGS_ARITHMETIC_KERNELS_ONLY*/
@@ -10,7 +10,7 @@ using namespace std;
 
 //****************************************************************************80
 
-void nelmin ( std::function<double(double[])> fn, int n, double start[], double xmin[],
+void nelmin ( function_ref<double(double[])> fn, int n, double start[], double xmin[],
   double *ynewlo, double reqmin, double step[], int konvge, int kcount, 
   int *icount, int *numres, int *ifault )
 
@@ -492,3 +492,490 @@ void nelmin ( std::function<double(double[])> fn, int n, double start[], double
 
   return;
 }
+//****************************************************************************80
+
+void nelmin ( std::function<double(double[])> fn, int n, double start[], double xmin[],
+  double *ynewlo, double reqmin, double step[], int konvge, int kcount, 
+  int *icount, int *numres, int *ifault )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    NELMIN overload taking a std::function. Forwards to the function_ref version.
+//
+{
+  nelmin ( function_ref<double(double[])> ( fn ), n, start, xmin, ynewlo, 
+    reqmin, step, konvge, kcount, icount, numres, ifault );
+}
+//****************************************************************************80
+
+static void nelmin_batch ( function_ref<double(double[])> fn, int n, int npts,
+  double pts[], double ys[], int *icount )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    NELMIN_BATCH evaluates NPTS points stored one after another in PTS
+//    in parallel.
+//
+{
+  int k;
+
+# pragma omp parallel for schedule(dynamic, 1)
+  for ( k = 0; k < npts; k++ )
+  {
+    ys[k] = fn ( pts + k * n );
+  }
+  *icount = *icount + npts;
+
+  return;
+}
+//****************************************************************************80
+
+void nelmin_parallel ( function_ref<double(double[])> fn, int n, double start[],
+  double xmin[], double *ynewlo, double reqmin, double step[], int konvge,
+  int kcount, int *icount, int *numres, int *ifault, int nupdate )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    NELMIN_PARALLEL minimizes a function with a parallel Nelder-Mead method.
+//
+//  Discussion:
+//
+//    This is meant for expensive objectives where each evaluation
+//    dominates the bookkeeping. FN is called concurrently so it must
+//    be thread-safe.
+//
+//    Each iteration updates the NUPDATE worst vertices at once, each
+//    reflected through the centroid of the remaining vertices, as in
+//    Lee and Wiswall (2007). The reflection, expansion and both
+//    contraction points of every updated vertex are evaluated
+//    speculatively in one parallel batch and the usual O'Neill decision
+//    rules then pick among them. The whole simplex is only shrunk when
+//    none of the updated vertices improved, and the new vertices are
+//    again evaluated in parallel, as are the initial simplex and the
+//    factorial tests.
+//
+//    With NUPDATE = 1 and a deterministic FN, the iterates, ICOUNT,
+//    NUMRES and IFAULT are the same as those of NELMIN. Ties between
+//    vertices are broken the same way, ILO is tracked the same way and
+//    the shrink re-evaluates every vertex.
+//
+//    REQMIN, KONVGE and KCOUNT keep their meaning from NELMIN. KONVGE
+//    counts iterations, each of which updates NUPDATE vertices.
+//    ICOUNT and KCOUNT only count the evaluations NELMIN would have
+//    made for each updated vertex. The speculative evaluations that go
+//    unused are not counted, so FN is called up to twice as often.
+//
+//  Reference:
+//
+//    Donghoon Lee, Matthew Wiswall,
+//    A Parallel Implementation of the Simplex Function Minimization Routine,
+//    Computational Economics,
+//    Volume 30, Number 2, 2007, pages 171-187.
+//
+//  Parameters:
+//
+//    Same as NELMIN, plus:
+//
+//    Input, int NUPDATE, the number of worst vertices replaced per
+//    iteration. Clamped to [1, N - 1] so at least two vertices are left
+//    to form the centroid when N > 1. Each iteration evaluates
+//    4 * NUPDATE points in parallel.
+//
+{
+  double ccoeff = 0.5;
+  double ecoeff = 2.0;
+  double eps = 0.001;
+  double rcoeff = 1.0;
+  double del;
+  double dn;
+  double dnn;
+  double rq;
+  double x;
+  double z;
+  double ylo;
+  int i;
+  int ilo;
+  int j;
+  int jcount;
+  int k;
+  int l;
+  int nn;
+  int nbest;
+  int improved;
+  int *order;
+  int *picks;
+  double *p;
+  double *pbar;
+  double *pts;
+  double *y;
+  double *ys;
+//
+//  Check the input parameters.
+//
+  if ( reqmin <= 0.0 || n < 1 || konvge < 1 )
+  {
+    *ifault = 1;
+    return;
+  }
+
+  if ( n - 1 < nupdate )
+  {
+    nupdate = n - 1;
+  }
+  if ( nupdate < 1 )
+  {
+    nupdate = 1;
+  }
+
+  nn = n + 1;
+  nbest = nn - nupdate;
+
+  p = new double[n*nn];
+  pbar = new double[n];
+  y = new double[nn];
+  order = new int[nn];
+  picks = new int[nupdate];
+//
+//  Scratch for every batch: 4 candidates per updated vertex,
+//  N + 1 vertices after a shrink and 2 * N factorial tests.
+//
+  k = 4 * nupdate;
+  if ( k < 2 * n )
+  {
+    k = 2 * n;
+  }
+  pts = new double[n*k];
+  ys = new double[k];
+
+  *icount = 0;
+  *numres = 0;
+
+  jcount = konvge;
+  dn = ( double ) ( n );
+  dnn = ( double ) ( nn );
+  del = 1.0;
+  rq = reqmin * dn;
+//
+//  Initial or restarted loop.
+//
+  for ( ; ; )
+  {
+    for ( j = 0; j < nn; j++ )
+    {
+      for ( i = 0; i < n; i++ )
+      {
+        p[i+j*n] = start[i];
+      }
+      if ( j < n )
+      {
+        p[j+j*n] = start[j] + step[j] * del;
+      }
+    }
+    for ( i = 0; i < n * nn; i++ )
+    {
+      pts[i] = p[i];
+    }
+    nelmin_batch ( fn, n, nn, pts, y, icount );
+
+    ylo = y[0];
+    ilo = 0;
+    for ( i = 1; i < nn; i++ )
+    {
+      if ( y[i] < ylo )
+      {
+        ylo = y[i];
+        ilo = i;
+      }
+    }
+//
+//  Inner loop.
+//
+    for ( ; ; )
+    {
+      if ( kcount <= *icount )
+      {
+        break;
+      }
+//
+//  Move the NUPDATE worst vertices to the end of ORDER, each found
+//  the way NELMIN finds IHI, so ORDER[NN-1] is the vertex NELMIN
+//  would replace, ties and NaNs included.
+//
+      for ( i = 0; i < nn; i++ )
+      {
+        order[i] = i;
+      }
+      for ( l = nn - 1; nbest <= l; l-- )
+      {
+        k = 0;
+        for ( i = 1; i <= l; i++ )
+        {
+          if ( y[order[k]] < y[order[i]] )
+          {
+            k = i;
+          }
+        }
+        j = order[k];
+        for ( i = k; i < l; i++ )
+        {
+          order[i] = order[i+1];
+        }
+        order[l] = j;
+      }
+      *ynewlo = y[order[nn-1]];
+//
+//  Calculate PBAR, the centroid of the NBEST best vertices,
+//  summed in the same order as NELMIN.
+//
+      for ( i = 0; i < n; i++ )
+      {
+        z = 0.0;
+        for ( j = 0; j < nn; j++ )
+        {
+          z = z + p[i+j*n];
+        }
+        for ( k = 0; k < nupdate; k++ )
+        {
+          z = z - p[i+order[nbest+k]*n];
+        }
+        pbar[i] = z / ( double ) ( nbest );
+      }
+//
+//  Speculative candidates of each updated vertex:
+//  reflection, expansion, outside and inside contraction.
+//
+      for ( k = 0; k < nupdate; k++ )
+      {
+        j = order[nbest+k];
+        for ( i = 0; i < n; i++ )
+        {
+          x = pbar[i] + rcoeff * ( pbar[i] - p[i+j*n] );
+          pts[i+(4*k  )*n] = x;
+          pts[i+(4*k+1)*n] = pbar[i] + ecoeff * ( x - pbar[i] );
+          pts[i+(4*k+2)*n] = pbar[i] + ccoeff * ( x - pbar[i] );
+          pts[i+(4*k+3)*n] = pbar[i] + ccoeff * ( p[i+j*n] - pbar[i] );
+        }
+      }
+      l = 0;
+      nelmin_batch ( fn, n, 4 * nupdate, pts, ys, &l );
+//
+//  Decide every vertex against the simplex from the start of the
+//  iteration, as if it were the only vertex being replaced.
+//  Only the evaluations NELMIN would have made are counted.
+//
+      improved = 0;
+      for ( k = 0; k < nupdate; k++ )
+      {
+        double ystar = ys[4*k];
+        int pick = -1;
+        j = order[nbest+k];
+
+        if ( ystar < ylo )
+        {
+          pick = ( ystar < ys[4*k+1] ) ? 0 : 1;
+          *icount = *icount + 2;
+        }
+        else
+        {
+          l = 0;
+          for ( i = 0; i < nn; i++ )
+          {
+            if ( ystar < y[i] )
+            {
+              l = l + 1;
+            }
+          }
+
+          if ( 1 < l )
+          {
+            pick = 0;
+            *icount = *icount + 1;
+          }
+          else if ( l == 0 )
+          {
+            if ( !( y[j] < ys[4*k+3] ) )
+            {
+              pick = 3;
+            }
+            *icount = *icount + 2;
+          }
+          else
+          {
+            pick = ( ys[4*k+2] <= ystar ) ? 2 : 0;
+            *icount = *icount + 2;
+          }
+        }
+
+        picks[k] = pick;
+      }
+
+      for ( k = 0; k < nupdate; k++ )
+      {
+        if ( 0 <= picks[k] )
+        {
+          j = order[nbest+k];
+          for ( i = 0; i < n; i++ )
+          {
+            p[i+j*n] = pts[i+(4*k+picks[k])*n];
+          }
+          y[j] = ys[4*k+picks[k]];
+          improved = 1;
+        }
+      }
+//
+//  Contract the whole simplex towards the best vertex.
+//  Like NELMIN, the best vertex is evaluated again.
+//
+      if ( !improved )
+      {
+        for ( j = 0; j < nn; j++ )
+        {
+          for ( i = 0; i < n; i++ )
+          {
+            p[i+j*n] = ( p[i+j*n] + p[i+ilo*n] ) * 0.5;
+            pts[i+j*n] = p[i+j*n];
+          }
+        }
+        nelmin_batch ( fn, n, nn, pts, y, icount );
+
+        ylo = y[0];
+        ilo = 0;
+        for ( i = 1; i < nn; i++ )
+        {
+          if ( y[i] < ylo )
+          {
+            ylo = y[i];
+            ilo = i;
+          }
+        }
+        continue;
+      }
+
+      for ( k = 0; k < nupdate; k++ )
+      {
+        j = order[nbest+k];
+        if ( y[j] < ylo )
+        {
+          ylo = y[j];
+          ilo = j;
+        }
+      }
+
+      jcount = jcount - 1;
+
+      if ( 0 < jcount )
+      {
+        continue;
+      }
+//
+//  Check to see if minimum reached.
+//
+      if ( *icount <= kcount )
+      {
+        jcount = konvge;
+
+        z = 0.0;
+        for ( i = 0; i < nn; i++ )
+        {
+          z = z + y[i];
+        }
+        x = z / dnn;
+
+        z = 0.0;
+        for ( i = 0; i < nn; i++ )
+        {
+          z = z + pow ( y[i] - x, 2 );
+        }
+
+        if ( z <= rq )
+        {
+          break;
+        }
+      }
+    }
+//
+//  Factorial tests to check that YNEWLO is a local minimum.
+//
+    for ( i = 0; i < n; i++ )
+    {
+      xmin[i] = p[i+ilo*n];
+    }
+    *ynewlo = y[ilo];
+
+    if ( kcount < *icount )
+    {
+      *ifault = 2;
+      break;
+    }
+
+    for ( k = 0; k < 2 * n; k++ )
+    {
+      for ( i = 0; i < n; i++ )
+      {
+        pts[i+k*n] = xmin[i];
+      }
+      del = step[k/2] * eps;
+      pts[k/2+k*n] = xmin[k/2] + ( ( k % 2 == 0 ) ? del : -del );
+    }
+    l = 0;
+    nelmin_batch ( fn, n, 2 * n, pts, ys, &l );
+//
+//  NELMIN stops testing at the first improvement and restarts from it.
+//
+    *ifault = 0;
+    for ( k = 0; k < 2 * n; k++ )
+    {
+      if ( ys[k] < *ynewlo )
+      {
+        *ifault = 2;
+        break;
+      }
+    }
+    *icount = *icount + ( ( *ifault == 0 ) ? 2 * n : k + 1 );
+
+    if ( *ifault == 0 )
+    {
+      break;
+    }
+//
+//  Restart the procedure.
+//
+    for ( i = 0; i < n; i++ )
+    {
+      start[i] = pts[i+k*n];
+    }
+    del = eps;
+    *numres = *numres + 1;
+  }
+  delete [] order;
+  delete [] picks;
+  delete [] p;
+  delete [] pbar;
+  delete [] pts;
+  delete [] y;
+  delete [] ys;
+
+  return;
+}
+//****************************************************************************80
+
+void nelmin_parallel ( std::function<double(double[])> fn, int n, double start[],
+  double xmin[], double *ynewlo, double reqmin, double step[], int konvge,
+  int kcount, int *icount, int *numres, int *ifault, int nupdate )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    NELMIN_PARALLEL overload taking a std::function. Forwards to the function_ref version.
+//
+{
+  nelmin_parallel ( function_ref<double(double[])> ( fn ), n, start, xmin, ynewlo,
+    reqmin, step, konvge, kcount, icount, numres, ifault, nupdate );
+}
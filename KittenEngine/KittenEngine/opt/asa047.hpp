@@ -1,5 +1,39 @@
+#pragma once
 #include <functional>
+#include "function_ref.h"
 
+void nelmin ( function_ref<double(double[])> fn, int n, double start[], double xmin[], 
+  double *ynewlo, double reqmin, double step[], int konvge, int kcount, 
+  int *icount, int *numres, int *ifault );
 void nelmin ( std::function<double(double[])> fn, int n, double start[], double xmin[], 
   double *ynewlo, double reqmin, double step[], int konvge, int kcount, 
   int *icount, int *numres, int *ifault );
+
+// Any other callable is passed by reference without going through std::function
+template <typename F>
+void nelmin ( F&& fn, int n, double start[], double xmin[], 
+  double *ynewlo, double reqmin, double step[], int konvge, int kcount, 
+  int *icount, int *numres, int *ifault )
+{
+  nelmin ( function_ref<double(double[])> ( fn ), n, start, xmin, ynewlo, 
+    reqmin, step, konvge, kcount, icount, numres, ifault );
+}
+
+// Parallel speculative variant of nelmin. fn must be thread-safe.
+// Replaces the nupdate worst vertices per iteration, clamped to [1, n - 1].
+// With nupdate = 1 the iterates and counts match nelmin.
+void nelmin_parallel ( function_ref<double(double[])> fn, int n, double start[], 
+  double xmin[], double *ynewlo, double reqmin, double step[], int konvge, 
+  int kcount, int *icount, int *numres, int *ifault, int nupdate = 1 );
+void nelmin_parallel ( std::function<double(double[])> fn, int n, double start[], 
+  double xmin[], double *ynewlo, double reqmin, double step[], int konvge, 
+  int kcount, int *icount, int *numres, int *ifault, int nupdate = 1 );
+
+template <typename F>
+void nelmin_parallel ( F&& fn, int n, double start[], double xmin[], 
+  double *ynewlo, double reqmin, double step[], int konvge, int kcount, 
+  int *icount, int *numres, int *ifault, int nupdate = 1 )
+{
+  nelmin_parallel ( function_ref<double(double[])> ( fn ), n, start, xmin, 
+    ynewlo, reqmin, step, konvge, kcount, icount, numres, ifault, nupdate );
+}
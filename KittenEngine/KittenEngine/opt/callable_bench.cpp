@@ -0,0 +1,121 @@
+#include "../includes/modules/Algo.h"
+#include "asa047.hpp"
+#include "compass_search.hpp"
+#include "praxis.hpp"
+#include "toms178.hpp"
+
+namespace Kitten {
+	void benchCallables(int itr) {
+		StopWatch timer;
+		timer.gpuSync = false;
+		double sink = 0;
+
+		auto integrand = [](double x) { return x * x + 1; };
+		auto energy = [](double x) { return pow2(x - 0.3); };
+		auto gradEnergy = [](dvec3 x) { return dot(x, x); };
+		std::function<double(double)> integrandFunc = integrand;
+		std::function<double(double)> energyFunc = energy;
+		std::function<double(dvec3)> gradEnergyFunc = gradEnergy;
+
+		timer.reset();
+		for (int i = 0; i < itr; i++) sink += adpInt<double>(integrand, 0, 1 + 1e-6 * i, 1e-7);
+		timer.time("adpInt template");
+		for (int i = 0; i < itr; i++) sink += adpInt<double>(integrandFunc, 0, 1 + 1e-6 * i, 1e-7);
+		timer.time("adpInt std::function");
+
+		for (int i = 0; i < itr; i++) sink += goldenIntMinSearch(energy, -1, 1 + 1e-6 * i, 1e-12).x;
+		timer.time("goldenIntMinSearch template");
+		for (int i = 0; i < itr; i++) sink += goldenIntMinSearch(energyFunc, -1, 1 + 1e-6 * i, 1e-12).x;
+		timer.time("goldenIntMinSearch std::function");
+
+		for (int i = 0; i < itr; i++) sink += nDiff<dvec3>(gradEnergy, dvec3(1e-6 * i)).x;
+		timer.time("nDiff template");
+		for (int i = 0; i < itr; i++) sink += nDiff<dvec3>(gradEnergyFunc, dvec3(1e-6 * i)).x;
+		timer.time("nDiff std::function");
+
+		// The optimizers run to convergence on the 2D Rosenbrock function so they get fewer repetitions.
+		// lbfgsMin() works in float and cannot reach its default tolerance here.
+		const int optItr = std::max(1, itr / 100);
+		auto rosen = [](const double* x) { return 100 * pow2(x[1] - x[0] * x[0]) + pow2(1 - x[0]); };
+
+		auto rosenF = [](Eigen::VectorXf x) { return 100 * pow2(x[1] - x[0] * x[0]) + pow2(1 - x[0]); };
+		auto rosenG = [](Eigen::VectorXf x) {
+			Eigen::VectorXf g(2);
+			g << -400 * x[0] * (x[1] - x[0] * x[0]) - 2 * (1 - x[0]), 200 * (x[1] - x[0] * x[0]);
+			return g;
+			};
+		std::function<float(Eigen::VectorXf)> rosenFFunc = rosenF;
+		std::function<Eigen::VectorXf(Eigen::VectorXf)> rosenGFunc = rosenG;
+		for (int i = 0; i < optItr; i++) {
+			Eigen::VectorXf guess(2);
+			guess << -1.2f, 1.f + 1e-6f * i;
+			sink += lbfgsMin(2, rosenF, rosenG, guess, 1e-3f)[0];
+		}
+		timer.time("lbfgsMin template");
+		for (int i = 0; i < optItr; i++) {
+			Eigen::VectorXf guess(2);
+			guess << -1.2f, 1.f + 1e-6f * i;
+			sink += lbfgsMin(2, rosenFFunc, rosenGFunc, guess, 1e-3f)[0];
+		}
+		timer.time("lbfgsMin std::function");
+
+		auto nelminFn = [&](double x[]) { return rosen(x); };
+		std::function<double(double[])> nelminFunc = nelminFn;
+		auto runNelmin = [&](auto& fn) {
+			for (int i = 0; i < optItr; i++) {
+				double start[2] = { -1.2, 1 + 1e-6 * i }, xmin[2], step[2] = { 1, 1 }, y;
+				int icount, numres, ifault;
+				nelmin(fn, 2, start, xmin, &y, 1e-12, step, 10, 2000, &icount, &numres, &ifault);
+				sink += xmin[0];
+			}
+			};
+		runNelmin(nelminFn);
+		timer.time("nelmin function_ref");
+		runNelmin(nelminFunc);
+		timer.time("nelmin std::function");
+
+		auto praxisFn = [&](double x[], int) { return rosen(x); };
+		std::function<double(double[], int)> praxisFunc = praxisFn;
+		auto runPraxis = [&](auto& fn) {
+			for (int i = 0; i < optItr; i++) {
+				double x[2] = { -1.2, 1 + 1e-6 * i };
+				sink += praxis(1e-8, 1, 2, 0, x, fn);
+			}
+			};
+		runPraxis(praxisFn);
+		timer.time("praxis function_ref");
+		runPraxis(praxisFunc);
+		timer.time("praxis std::function");
+
+		auto runHooke = [&](auto& fn) {
+			for (int i = 0; i < optItr; i++) {
+				double start[2] = { -1.2, 1 + 1e-6 * i }, end[2];
+				hooke(2, start, end, 0.5, 1e-8, 5000, fn);
+				sink += end[0];
+			}
+			};
+		runHooke(praxisFn);
+		timer.time("hooke function_ref");
+		runHooke(praxisFunc);
+		timer.time("hooke std::function");
+
+		auto compassFn = [&](int, double x[]) { return rosen(x); };
+		std::function<double(int, double[])> compassFunc = compassFn;
+		auto runCompass = [&](auto& fn) {
+			for (int i = 0; i < optItr; i++) {
+				double x0[2] = { -1.2, 1 + 1e-6 * i }, fx;
+				int k;
+				double* x = compass_search(fn, 2, x0, 1e-8, 0.3, 20000, fx, k);
+				sink += x[0];
+				delete[] x;
+			}
+			};
+		runCompass(compassFn);
+		timer.time("compass_search function_ref");
+		runCompass(compassFunc);
+		timer.time("compass_search std::function");
+
+		timer.printTimes();
+		printf("(checksum %f)\n", sink);
+	}
+}
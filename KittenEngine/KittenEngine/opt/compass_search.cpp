@@ -9,7 +9,7 @@ using namespace std;
 
 //****************************************************************************80
 
-double *compass_search ( std::function<double(int, double[])> function_handle, int m,
+double *compass_search ( function_ref<double(int, double[])> function_handle, int m,
   double x0[], double delta_tol, double delta_init, int k_max, double &fx, 
   int &k )
 
@@ -148,3 +148,19 @@ double *compass_search ( std::function<double(int, double[])> function_handle, i
   return x;
 }
 //****************************************************************************80
+
+double *compass_search ( std::function<double(int, double[])> function_handle, int m,
+  double x0[], double delta_tol, double delta_init, int k_max, double &fx,
+  int &k )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    COMPASS_SEARCH overload taking a std::function. Forwards to the function_ref version.
+//
+{
+  return compass_search ( function_ref<double(int, double[])> ( function_handle ), 
+    m, x0, delta_tol, delta_init, k_max, fx, k );
+}
+//****************************************************************************80
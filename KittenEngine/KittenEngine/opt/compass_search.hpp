@@ -1,6 +1,21 @@
+#pragma once
 #include <functional>
+#include "function_ref.h"
 #include "math.h"
 
+double *compass_search ( function_ref<double(int, double[])>, int m, 
+  double x0[], double delta_tol, double delta_init, int k_max, double &fx, 
+  int &k );
 double *compass_search ( std::function<double(int, double[])>, int m, 
   double x0[], double delta_tol, double delta_init, int k_max, double &fx, 
   int &k );
+
+// Any other callable is passed by reference without going through std::function
+template <typename F>
+double *compass_search ( F&& function_handle, int m, 
+  double x0[], double delta_tol, double delta_init, int k_max, double &fx, 
+  int &k )
+{
+  return compass_search ( function_ref<double(int, double[])> ( function_handle ), 
+    m, x0, delta_tol, delta_init, k_max, fx, k );
+}
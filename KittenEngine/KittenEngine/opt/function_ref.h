@@ -0,0 +1,53 @@
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+//
+//  A non-owning reference to a callable.
+//
+//  Unlike std::function, this never allocates and is trivially copyable,
+//  so it can be passed by value through the inner loops of the optimizers
+//  for the cost of two pointers. The referenced callable must outlive it.
+//
+template <typename Fn>
+class function_ref;
+
+template <typename R, typename... Args>
+class function_ref<R(Args...)> {
+	union {
+		void* obj;
+		void (*fn)();
+	};
+	R(*cb)(function_ref, Args...);
+
+	template <typename F>
+	static R invokeObj(function_ref self, Args... args) {
+		return (*(F*)self.obj)(std::forward<Args>(args)...);
+	}
+
+	template <typename F>
+	static R invokeFn(function_ref self, Args... args) {
+		return ((F*)self.fn)(std::forward<Args>(args)...);
+	}
+
+public:
+	template <typename F, typename = std::enable_if_t<
+		!std::is_same<std::decay_t<F>, function_ref>::value &&
+		std::is_invocable_r<R, F&, Args...>::value>>
+	function_ref(F&& f) noexcept {
+		using Fr = std::remove_reference_t<F>;
+		if constexpr (std::is_function<Fr>::value) {
+			fn = (void(*)())&f;
+			cb = &invokeFn<Fr>;
+		}
+		else {
+			obj = (void*)std::addressof(f);
+			cb = &invokeObj<Fr>;
+		}
+	}
+
+	R operator()(Args... args) const {
+		return cb(*this, std::forward<Args>(args)...);
+	}
+};
@@ -0,0 +1,49 @@
+#pragma once
+// Minimal SIMD lane types so one templated kernel serves SSE and AVX.
+
+#include <immintrin.h>
+
+namespace Kitten {
+	struct Lane4 {
+		__m128 v;
+		static constexpr int width = 4;
+		Lane4() = default;
+		Lane4(__m128 v) : v(v) {}
+		Lane4(float f) : v(_mm_set1_ps(f)) {}
+		static Lane4 load(const float* p) { return _mm_load_ps(p); }
+		static Lane4 loadu(const float* p) { return _mm_loadu_ps(p); }
+		void store(float* p) const { _mm_store_ps(p, v); }
+		void storeu(float* p) const { _mm_storeu_ps(p, v); }
+		friend Lane4 operator+(Lane4 a, Lane4 b) { return _mm_add_ps(a.v, b.v); }
+		friend Lane4 operator-(Lane4 a, Lane4 b) { return _mm_sub_ps(a.v, b.v); }
+		friend Lane4 operator*(Lane4 a, Lane4 b) { return _mm_mul_ps(a.v, b.v); }
+		friend Lane4 operator/(Lane4 a, Lane4 b) { return _mm_div_ps(a.v, b.v); }
+		friend Lane4 operator-(Lane4 a) { return _mm_xor_ps(_mm_set1_ps(-0.f), a.v); }
+		friend Lane4 sqrt(Lane4 a) { return _mm_sqrt_ps(a.v); }
+		friend Lane4 abs(Lane4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a.v); }
+	};
+
+#ifdef __AVX__
+	struct Lane8 {
+		__m256 v;
+		static constexpr int width = 8;
+		Lane8() = default;
+		Lane8(__m256 v) : v(v) {}
+		Lane8(float f) : v(_mm256_set1_ps(f)) {}
+		static Lane8 load(const float* p) { return _mm256_load_ps(p); }
+		static Lane8 loadu(const float* p) { return _mm256_loadu_ps(p); }
+		void store(float* p) const { _mm256_store_ps(p, v); }
+		void storeu(float* p) const { _mm256_storeu_ps(p, v); }
+		friend Lane8 operator+(Lane8 a, Lane8 b) { return _mm256_add_ps(a.v, b.v); }
+		friend Lane8 operator-(Lane8 a, Lane8 b) { return _mm256_sub_ps(a.v, b.v); }
+		friend Lane8 operator*(Lane8 a, Lane8 b) { return _mm256_mul_ps(a.v, b.v); }
+		friend Lane8 operator/(Lane8 a, Lane8 b) { return _mm256_div_ps(a.v, b.v); }
+		friend Lane8 operator-(Lane8 a) { return _mm256_xor_ps(_mm256_set1_ps(-0.f), a.v); }
+		friend Lane8 sqrt(Lane8 a) { return _mm256_sqrt_ps(a.v); }
+		friend Lane8 abs(Lane8 a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a.v); }
+	};
+	typedef Lane8 WideLane;
+#else
+	typedef Lane4 WideLane;
+#endif
+}
@@ -84,6 +84,10 @@ licence.
 /* Use SSE optimization for 32bit float precision. */
 #include "arithmetic_sse_float.h"
 
+#elif   !defined(LBFGS_NO_AVX) && (defined(_M_X64) || defined(__x86_64__))
+/* Use AVX2/AVX-512 picked at runtime, with OpenMP for very large n. */
+#include "arithmetic_avx.h"
+
 #else
 /* No CPU specific optimization. */
 #include "arithmetic_ansi.h"
@@ -515,6 +515,20 @@ lbfgsfloatval_t* lbfgs_malloc(int n);
  */
 void lbfgs_free(lbfgsfloatval_t *x);
 
+/**
+ * Benchmark the vector operations.
+ *
+ *  Prints the time per call of vecdot, vecadd, vecdiff and vecscale for
+ *  the SSE path, each AVX backend supported by the CPU and the OpenMP
+ *  variant used for very large n. The OpenMP row is only timed when n is
+ *  at least LBFGS_OMP_THRESHOLD (2^18 by default), since it runs serially
+ *  below that.
+ *
+ *  @param  n           The number of variables.
+ *  @param  itr         The number of calls to average over.
+ */
+void lbfgs_arithmetic_benchmark(int n, int itr);
+
 /** @} */
 
 #ifdef  __cplusplus
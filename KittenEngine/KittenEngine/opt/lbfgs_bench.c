@@ -0,0 +1,148 @@
+/*
+ *      Benchmark of the vector operations used by lbfgs().
+ *
+ * Times vecdot, vecadd, vecdiff and vecscale for the SSE macros, every
+ * dispatch table in arithmetic_avx.h and the OpenMP variant of the widest
+ * supported one.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <math.h>
+
+#include "./lbfgs.h"
+
+#ifdef  _MSC_VER
+#define inline  __inline
+#endif/*_MSC_VER*/
+
+#if     defined(_M_X64) || defined(__x86_64__)
+
+#define LBFGS_ARITHMETIC_KERNELS_ONLY
+#include "arithmetic_avx.h"
+
+#if     LBFGS_FLOAT == 64
+#include "arithmetic_sse_double.h"
+#else
+#include "arithmetic_sse_float.h"
+#endif/*LBFGS_FLOAT == 64*/
+
+static double bench_now(void)
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1e3 + ts.tv_nsec * 1e-6;
+}
+
+static void bench_print(const char *name, double t[4], int itr)
+{
+    printf("%-10s dot %8.3f ms  add %8.3f ms  diff %8.3f ms  scale %8.3f ms\n",
+        name, t[0] / itr, t[1] / itr, t[2] / itr, t[3] / itr);
+}
+
+static void bench_ops(const char *name, const vecops_t *ops, int parallel,
+    lbfgsfloatval_t *x, lbfgsfloatval_t *y, lbfgsfloatval_t *z, int n, int itr, lbfgsfloatval_t *sink)
+{
+    int k;
+    double t[4], start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) *sink += parallel ? par_vecdot(ops, x, y, n) : ops->dot(x, y, n);
+    t[0] = bench_now() - start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) {
+        if (parallel) par_vecadd(ops, y, x, (lbfgsfloatval_t)1e-3, n);
+        else ops->add(y, x, (lbfgsfloatval_t)1e-3, n);
+    }
+    t[1] = bench_now() - start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) {
+        if (parallel) par_vecdiff(ops, z, x, y, n);
+        else ops->diff(z, x, y, n);
+    }
+    t[2] = bench_now() - start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) {
+        if (parallel) par_vecscale(ops, y, (lbfgsfloatval_t)0.999, n);
+        else ops->scale(y, (lbfgsfloatval_t)0.999, n);
+    }
+    t[3] = bench_now() - start;
+
+    bench_print(name, t, itr);
+}
+
+void lbfgs_arithmetic_benchmark(int n, int itr)
+{
+    int i, k;
+    double t[4], start;
+    lbfgsfloatval_t s, sink = 0.;
+    lbfgsfloatval_t *x, *y, *z;
+    const vecops_t *best = vecops_select(LBFGS_ARITHMETIC_AVX512);
+
+    /* The SSE macros need 16-byte alignment and a multiple of 16 elements */
+    n = (n + 15) / 16 * 16;
+    x = (lbfgsfloatval_t*)vecalloc(sizeof(lbfgsfloatval_t) * n);
+    y = (lbfgsfloatval_t*)vecalloc(sizeof(lbfgsfloatval_t) * n);
+    z = (lbfgsfloatval_t*)vecalloc(sizeof(lbfgsfloatval_t) * n);
+    for (i = 0;i < n;++i) {
+        x[i] = (lbfgsfloatval_t)sin(0.001 * i);
+        y[i] = (lbfgsfloatval_t)cos(0.001 * i);
+    }
+
+    printf("lbfgs arithmetic benchmark: n = %d, %d iterations, best = %s\n", n, itr, best->name);
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) {
+        vecdot(&s, x, y, n);
+        sink += s;
+    }
+    t[0] = bench_now() - start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) vecadd(y, x, (lbfgsfloatval_t)1e-3, n);
+    t[1] = bench_now() - start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) vecdiff(z, x, y, n);
+    t[2] = bench_now() - start;
+
+    start = bench_now();
+    for (k = 0;k < itr;++k) vecscale(y, (lbfgsfloatval_t)0.999, n);
+    t[3] = bench_now() - start;
+    bench_print("sse", t, itr);
+
+    for (i = 0;i <= LBFGS_ARITHMETIC_AVX512;++i)
+        if (vecops_select(i) == &vecops_table[i])
+            bench_ops(vecops_table[i].name, &vecops_table[i], 0, x, y, z, n, itr, &sink);
+    /* The OpenMP variant falls back to the serial kernels below LBFGS_OMP_THRESHOLD */
+    if (n >= LBFGS_OMP_THRESHOLD)
+        bench_ops("parallel", best, 1, x, y, z, n, itr, &sink);
+    else
+        printf("parallel   skipped, n is below LBFGS_OMP_THRESHOLD (%d) and would run serially\n", LBFGS_OMP_THRESHOLD);
+
+    printf("(ignore %g)\n", (double)sink);
+
+#ifdef  _MSC_VER
+    _aligned_free(x);
+    _aligned_free(y);
+    _aligned_free(z);
+#else
+    free(x);
+    free(y);
+    free(z);
+#endif
+}
+
+#else
+
+void lbfgs_arithmetic_benchmark(int n, int itr)
+{
+    printf("lbfgs arithmetic benchmark: only available on x86-64\n");
+}
+
+#endif
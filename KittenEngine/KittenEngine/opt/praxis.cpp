@@ -11,7 +11,7 @@ using namespace std;
 
 //****************************************************************************80
 
-double flin ( int n, int jsearch, double l, std::function<double(double[], int)> f,
+double flin ( int n, int jsearch, double l, function_ref<double(double[], int)> f,
   double x[], int &nf, double v[], double q0[], double q1[], double &qd0, 
   double &qd1, double &qa, double &qb, double &qc )
 
@@ -555,7 +555,7 @@ void minfit ( int n, double tol, double a[], double q[] )
 //****************************************************************************80
 
 void minny ( int n, int jsearch, int nits, double &d2, double &x1, double &f1, 
-  bool fk, std::function<double(double[], int)> f, double x[], double t, double h,
+  bool fk, function_ref<double(double[], int)> f, double x[], double t, double h,
   double v[], double q0[], double q1[], int &nl, int &nf, double dmin, 
   double ldt, double &fx, double &qa, double &qb, double &qc, double &qd0, 
   double &qd1 )
@@ -875,7 +875,7 @@ void minny ( int n, int jsearch, int nits, double &d2, double &x1, double &f1,
 //****************************************************************************80
 
 double praxis ( double t0, double h0, int n, int prin, double x[], 
-    std::function<double(double[], int)> f)
+    function_ref<double(double[], int)> f)
 
 //****************************************************************************80
 //
@@ -1597,7 +1597,7 @@ void print2 ( int n, double x[], int prin, double fx, int nf, int nl )
 }
 //****************************************************************************80
 
-void quad ( int n, std::function<double(double[], int)> f, double x[], double t,
+void quad ( int n, function_ref<double(double[], int)> f, double x[], double t,
   double h, double v[], double q0[], double q1[], int &nl, int &nf, double dmin, 
   double ldt, double &fx, double &qf1, double &qa, double &qb, double &qc, 
   double &qd0, double &qd1 )
@@ -1728,3 +1728,17 @@ void quad ( int n, std::function<double(double[], int)> f, double x[], double t,
   return;
 }
 //****************************************************************************80
+
+double praxis ( double t0, double h0, int n, int prin, double x[], 
+  std::function<double(double[], int)> f )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    PRAXIS overload taking a std::function. Forwards to the function_ref version.
+//
+{
+  return praxis ( t0, h0, n, prin, x, function_ref<double(double[], int)> ( f ) );
+}
+//****************************************************************************80
@@ -1,9 +1,33 @@
 #pragma once
 
 #include "../includes/modules/Common.h"
+#include "../includes/modules/Rotor.h"
 
 namespace Kitten {
 	void svd(const mat3& m, mat3& u, vec3& s, mat3& v);
 	void svd(mat2 m, mat2& U, vec2& sig, mat2& V);
 	void polarDecomp(mat2 m, mat2& R, mat2& S);
+
+	// Batched 3x3 SVD of n matrices with the McAdams kernel running 4 (SSE), 8 (AVX) or 16 (AVX512) wide.
+	// Matrices are staged into SoA blocks internally. Any of u, s and v may be null.
+	// These run on the calling thread. Variants not enabled by the build fall back to the next narrower one.
+	void svdSSE(const mat3* m, mat3* u, vec3* s, mat3* v, int n);
+	void svdAVX(const mat3* m, mat3* u, vec3* s, mat3* v, int n);
+	void svdAVX512(const mat3* m, mat3* u, vec3* s, mat3* v, int n);
+
+	// Batched 3x3 SVD of n matrices split across OpenMP threads using the widest enabled kernel
+	void svd(const mat3* m, mat3* u, vec3* s, mat3* v, int n);
+
+	// Times the scalar path against each batched kernel and the OpenMP driver on n random matrices
+	void svdBenchmark(int n = 1 << 20);
+
+	// Rotation of m by Muller et al. 2016, "A Robust Method to Extract the Rotational Part of Deformations".
+	// Warm starts from q and runs a fixed number of iterations. q is updated in place.
+	void extractRotation(const mat3& m, Rotor& q, const int itr = 4);
+
+	// Batched extractRotation() over n matrices. Runs 8 (AVX) or 4 (SSE) wide across OpenMP threads.
+	void extractRotation(const mat3* m, Rotor* q, int n, const int itr = 4);
+
+	// Compares batched rotation extraction against the rotation from the batched SVD on n random deformations
+	void extractRotationBenchmark(int n = 1 << 20);
 }
\ No newline at end of file
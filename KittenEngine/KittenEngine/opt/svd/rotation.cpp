@@ -0,0 +1,153 @@
+#include "../svd.h"
+#include "../../includes/modules/StopWatch.h"
+#include "../lanes.h"
+#include <random>
+
+namespace Kitten {
+	// a[9] holds the matrix column major and q[4] the rotor as { x, y, z, w }.
+	// Each iteration rotates q by omega = sum_i R_i x A_i / |sum_i R_i . A_i|.
+	// The rotation is applied as the normalized rotor (omega / 2, 1), which avoids trig and matches to first order.
+	template<typename V>
+	static void extractRotationKernel(const V a[9], V q[4], const int itr) {
+		V x = q[0], y = q[1], z = q[2], w = q[3];
+		for (int k = 0; k < itr; k++) {
+			// Columns of the rotation matrix
+			const V xx = x * x, yy = y * y, zz = z * z;
+			const V xy = x * y, xz = x * z, yz = y * z;
+			const V wx = w * x, wy = w * y, wz = w * z;
+			const V r00 = 1.f - 2.f * (yy + zz), r01 = 2.f * (xy + wz), r02 = 2.f * (xz - wy);
+			const V r10 = 2.f * (xy - wz), r11 = 1.f - 2.f * (xx + zz), r12 = 2.f * (yz + wx);
+			const V r20 = 2.f * (xz + wy), r21 = 2.f * (yz - wx), r22 = 1.f - 2.f * (xx + yy);
+
+			// Sum of cross(R_i, A_i) and dot(R_i, A_i)
+			V ox = r01 * a[2] - r02 * a[1] + r11 * a[5] - r12 * a[4] + r21 * a[8] - r22 * a[7];
+			V oy = r02 * a[0] - r00 * a[2] + r12 * a[3] - r10 * a[5] + r22 * a[6] - r20 * a[8];
+			V oz = r00 * a[1] - r01 * a[0] + r10 * a[4] - r11 * a[3] + r20 * a[7] - r21 * a[6];
+			const V d = abs(r00 * a[0] + r01 * a[1] + r02 * a[2] + r10 * a[3] + r11 * a[4] + r12 * a[5]
+				+ r20 * a[6] + r21 * a[7] + r22 * a[8]) + 1e-9f;
+			const V s = 0.5f / d;
+			ox = ox * s;
+			oy = oy * s;
+			oz = oz * s;
+
+			// q = (omega / 2, 1) * q
+			const V nx = x + w * ox + (oy * z - oz * y);
+			const V ny = y + w * oy + (oz * x - ox * z);
+			const V nz = z + w * oz + (ox * y - oy * x);
+			const V nw = w - (ox * x + oy * y + oz * z);
+
+			const V inv = 1.f / sqrt(nx * nx + ny * ny + nz * nz + nw * nw);
+			x = nx * inv;
+			y = ny * inv;
+			z = nz * inv;
+			w = nw * inv;
+		}
+		q[0] = x;
+		q[1] = y;
+		q[2] = z;
+		q[3] = w;
+	}
+
+	void extractRotation(const mat3& m, Rotor& q, const int itr) {
+		float a[9];
+		for (int c = 0; c < 3; c++)
+			for (int r = 0; r < 3; r++)
+				a[3 * c + r] = m[c][r];
+		extractRotationKernel<float>(a, &q.x, itr);
+	}
+
+	template<typename V>
+	static void extractRotationBlock(const mat3* m, Rotor* q, int n, const int itr) {
+		constexpr int W = V::width;
+		alignas(32) float in[13][W];
+
+		for (int i = 0; i < n; i += W) {
+			// Stage into SoA. Lanes past n repeat the last element and are discarded.
+			for (int l = 0; l < W; l++) {
+				const int j = std::min(i + l, n - 1);
+				for (int c = 0; c < 3; c++)
+					for (int r = 0; r < 3; r++)
+						in[3 * c + r][l] = m[j][c][r];
+				for (int k = 0; k < 4; k++)
+					in[9 + k][l] = q[j][k];
+			}
+
+			V a[9], qv[4];
+			for (int k = 0; k < 9; k++) a[k] = V::load(in[k]);
+			for (int k = 0; k < 4; k++) qv[k] = V::load(in[9 + k]);
+			extractRotationKernel(a, qv, itr);
+			for (int k = 0; k < 4; k++) qv[k].store(in[9 + k]);
+
+			const int num = std::min(W, n - i);
+			for (int l = 0; l < num; l++)
+				q[i + l] = Rotor(in[9][l], in[10][l], in[11][l], in[12][l]);
+		}
+	}
+
+	void extractRotation(const mat3* m, Rotor* q, int n, const int itr) {
+		constexpr int blockSize = 1024;
+		const int numBlocks = (n + blockSize - 1) / blockSize;
+
+#pragma omp parallel for schedule(static, 1)
+		for (int b = 0; b < numBlocks; b++) {
+			const int i = b * blockSize;
+			extractRotationBlock<WideLane>(m + i, q + i, std::min(blockSize, n - i), itr);
+		}
+	}
+
+	void extractRotationBenchmark(int n) {
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dist(-1, 1);
+
+		// Rotated stretches, with warm starts a small rotation away like the previous step of a simulation
+		std::vector<mat3> m(n), u(n), v(n), ref(n);
+		std::vector<vec3> s(n);
+		std::vector<Rotor> start(n), q(n);
+		for (int i = 0; i < n; i++) {
+			const Rotor r = normalize(Rotor(dist(rng), dist(rng), dist(rng), dist(rng)));
+			mat3 stretch(1);
+			for (int c = 0; c < 3; c++)
+				for (int k = 0; k < 3; k++)
+					stretch[c][k] += 0.2f * dist(rng);
+			mat3 rm;
+			for (int c = 0; c < 3; c++)
+				rm[c] = r.rotate(vec3(c == 0, c == 1, c == 2));
+			m[i] = rm * stretch;
+			start[i] = normalize(Rotor(0.05f * vec3(dist(rng), dist(rng), dist(rng)), 1) * r);
+		}
+
+		auto rotationError = [&](const std::vector<Rotor>& q) {
+			float err = 0;
+			for (int i = 0; i < n; i++)
+				for (int c = 0; c < 3; c++)
+					err = std::max(err, length(q[i].rotate(vec3(c == 0, c == 1, c == 2)) - ref[i][c]));
+			return err;
+			};
+
+		printf("rotation extraction benchmark: n = %d\n", n);
+		StopWatch timer;
+		timer.gpuSync = false;
+
+		timer.reset();
+		svd(m.data(), u.data(), s.data(), v.data(), n);
+		for (int i = 0; i < n; i++)
+			ref[i] = u[i] * transpose(v[i]);
+		timer.time();
+		printf("svd           %8.3f ms\n", 1000 * timer.deltaTimes.back());
+
+		for (int itr : { 1, 2, 4, 8 }) {
+			q = start;
+			timer.reset();
+			for (int i = 0; i < n; i++)
+				extractRotation(m[i], q[i], itr);
+			timer.time();
+			printf("scalar  itr %d %8.3f ms  err %g\n", itr, 1000 * timer.deltaTimes.back(), rotationError(q));
+
+			q = start;
+			timer.reset();
+			extractRotation(m.data(), q.data(), n, itr);
+			timer.time();
+			printf("batched itr %d %8.3f ms  err %g\n", itr, 1000 * timer.deltaTimes.back(), rotationError(q));
+		}
+	}
+}
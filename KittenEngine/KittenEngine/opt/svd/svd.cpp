@@ -27,6 +27,24 @@ namespace Kitten {
 		u[0][2] = Sv31.f;  u[1][2] = Sv32.f;  u[2][2] = Sv33.f;
 	}
 
+	void svd(const mat3* m, mat3* u, vec3* s, mat3* v, int n) {
+		constexpr int blockSize = 1024;
+		const int numBlocks = (n + blockSize - 1) / blockSize;
+
+#pragma omp parallel for schedule(static, 1)
+		for (int b = 0; b < numBlocks; b++) {
+			const int i = b * blockSize;
+			const int num = std::min(blockSize, n - i);
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+			svdAVX512(m + i, u ? u + i : nullptr, s ? s + i : nullptr, v ? v + i : nullptr, num);
+#elif defined(__AVX__)
+			svdAVX(m + i, u ? u + i : nullptr, s ? s + i : nullptr, v ? v + i : nullptr, num);
+#else
+			svdSSE(m + i, u ? u + i : nullptr, s ? s + i : nullptr, v ? v + i : nullptr, num);
+#endif
+		}
+	}
+
 	void polarDecomp(mat2 m, mat2& R, mat2& S) {
 		auto x = m[0][0] + m[1][1];
 		auto y = m[0][1] - m[1][0];
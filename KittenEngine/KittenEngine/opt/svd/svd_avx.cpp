@@ -0,0 +1,20 @@
+#include "../svd.h"
+
+#ifdef __AVX__
+
+#define USE_AVX_IMPLEMENTATION
+#define SVD_BATCH_NAME svdAVX
+#define SVD_BATCH_WIDTH 8
+#define SVD_BATCH_LOAD _mm256_load_ps
+#define SVD_BATCH_STORE _mm256_store_ps
+#include "svd_batch.hpp"
+
+#else
+
+namespace Kitten {
+	void svdAVX(const mat3* m, mat3* u, vec3* s, mat3* v, int n) {
+		svdSSE(m, u, s, v, n);
+	}
+}
+
+#endif
@@ -0,0 +1,20 @@
+#include "../svd.h"
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+
+#define USE_AVX512_IMPLEMENTATION
+#define SVD_BATCH_NAME svdAVX512
+#define SVD_BATCH_WIDTH 16
+#define SVD_BATCH_LOAD _mm512_load_ps
+#define SVD_BATCH_STORE _mm512_store_ps
+#include "svd_batch.hpp"
+
+#else
+
+namespace Kitten {
+	void svdAVX512(const mat3* m, mat3* u, vec3* s, mat3* v, int n) {
+		svdAVX(m, u, s, v, n);
+	}
+}
+
+#endif
@@ -0,0 +1,55 @@
+// Batched driver around the McAdams kernel.
+// The including file defines one of USE_SSE_IMPLEMENTATION, USE_AVX_IMPLEMENTATION or USE_AVX512_IMPLEMENTATION
+// along with SVD_BATCH_NAME, SVD_BATCH_WIDTH, SVD_BATCH_LOAD and SVD_BATCH_STORE.
+
+#define COMPUTE_V_AS_MATRIX
+#define COMPUTE_U_AS_MATRIX
+#include "Singular_Value_Decomposition_Preamble.hpp"
+
+namespace Kitten {
+	void SVD_BATCH_NAME(const mat3* m, mat3* u, vec3* s, mat3* v, int n) {
+#include "Singular_Value_Decomposition_Kernel_Declarations.hpp"
+
+		// SoA staging for one block. Lanes past n repeat the last matrix and are discarded.
+		alignas(64) float in[9][SVD_BATCH_WIDTH];
+		alignas(64) float out[21][SVD_BATCH_WIDTH];
+
+		for (int i = 0; i < n; i += SVD_BATCH_WIDTH) {
+			for (int l = 0; l < SVD_BATCH_WIDTH; l++) {
+				const mat3& a = m[std::min(i + l, n - 1)];
+				for (int c = 0; c < 3; c++)
+					for (int r = 0; r < 3; r++)
+						in[3 * c + r][l] = a[c][r];
+			}
+
+			// Same transposed load as the scalar svd()
+			Va11 = SVD_BATCH_LOAD(in[0]); Va21 = SVD_BATCH_LOAD(in[3]); Va31 = SVD_BATCH_LOAD(in[6]);
+			Va12 = SVD_BATCH_LOAD(in[1]); Va22 = SVD_BATCH_LOAD(in[4]); Va32 = SVD_BATCH_LOAD(in[7]);
+			Va13 = SVD_BATCH_LOAD(in[2]); Va23 = SVD_BATCH_LOAD(in[5]); Va33 = SVD_BATCH_LOAD(in[8]);
+
+#include "Singular_Value_Decomposition_Main_Kernel_Body.hpp"
+
+			SVD_BATCH_STORE(out[0], Vu11); SVD_BATCH_STORE(out[1], Vu12); SVD_BATCH_STORE(out[2], Vu13);
+			SVD_BATCH_STORE(out[3], Vu21); SVD_BATCH_STORE(out[4], Vu22); SVD_BATCH_STORE(out[5], Vu23);
+			SVD_BATCH_STORE(out[6], Vu31); SVD_BATCH_STORE(out[7], Vu32); SVD_BATCH_STORE(out[8], Vu33);
+
+			SVD_BATCH_STORE(out[9], Va11); SVD_BATCH_STORE(out[10], Va22); SVD_BATCH_STORE(out[11], Va33);
+
+			SVD_BATCH_STORE(out[12], Vv11); SVD_BATCH_STORE(out[13], Vv12); SVD_BATCH_STORE(out[14], Vv13);
+			SVD_BATCH_STORE(out[15], Vv21); SVD_BATCH_STORE(out[16], Vv22); SVD_BATCH_STORE(out[17], Vv23);
+			SVD_BATCH_STORE(out[18], Vv31); SVD_BATCH_STORE(out[19], Vv32); SVD_BATCH_STORE(out[20], Vv33);
+
+			const int num = std::min(SVD_BATCH_WIDTH, n - i);
+			for (int l = 0; l < num; l++) {
+				// The kernel's U and V swap roles because of the transposed load
+				if (v) for (int c = 0; c < 3; c++)
+					for (int r = 0; r < 3; r++)
+						v[i + l][c][r] = out[3 * r + c][l];
+				if (s) s[i + l] = vec3(out[9][l], out[10][l], out[11][l]);
+				if (u) for (int c = 0; c < 3; c++)
+					for (int r = 0; r < 3; r++)
+						u[i + l][c][r] = out[12 + 3 * r + c][l];
+			}
+		}
+	}
+}
@@ -0,0 +1,61 @@
+#include "../svd.h"
+#include "../../includes/modules/StopWatch.h"
+#include <random>
+
+namespace Kitten {
+	// Largest reconstruction error |U diag(S) V^T - M| over the batch
+	static float svdBatchError(const std::vector<mat3>& m, const std::vector<mat3>& u, const std::vector<vec3>& s, const std::vector<mat3>& v) {
+		float err = 0;
+		for (size_t i = 0; i < m.size(); i++) {
+			const mat3 d = svdMul(u[i], s[i], v[i]) - m[i];
+			for (int c = 0; c < 3; c++)
+				err = std::max(err, length(d[c]));
+		}
+		return err;
+	}
+
+	void svdBenchmark(int n) {
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dist(-1, 1);
+		std::vector<mat3> m(n), u(n), v(n);
+		std::vector<vec3> s(n);
+		for (auto& a : m)
+			for (int c = 0; c < 3; c++)
+				a[c] = vec3(dist(rng), dist(rng), dist(rng));
+
+		printf("svd benchmark: n = %d\n", n);
+		StopWatch timer;
+		timer.gpuSync = false;
+
+		timer.reset();
+		for (int i = 0; i < n; i++)
+			svd(m[i], u[i], s[i], v[i]);
+		timer.time();
+		double t = timer.deltaTimes.back();
+		printf("scalar   %8.3f ms  err %g\n", 1000 * t, svdBatchError(m, u, s, v));
+
+		timer.reset();
+		svdSSE(m.data(), u.data(), s.data(), v.data(), n);
+		timer.time();
+		t = timer.deltaTimes.back();
+		printf("sse      %8.3f ms  err %g\n", 1000 * t, svdBatchError(m, u, s, v));
+
+		timer.reset();
+		svdAVX(m.data(), u.data(), s.data(), v.data(), n);
+		timer.time();
+		t = timer.deltaTimes.back();
+		printf("avx      %8.3f ms  err %g\n", 1000 * t, svdBatchError(m, u, s, v));
+
+		timer.reset();
+		svdAVX512(m.data(), u.data(), s.data(), v.data(), n);
+		timer.time();
+		t = timer.deltaTimes.back();
+		printf("avx512   %8.3f ms  err %g\n", 1000 * t, svdBatchError(m, u, s, v));
+
+		timer.reset();
+		svd(m.data(), u.data(), s.data(), v.data(), n);
+		timer.time();
+		t = timer.deltaTimes.back();
+		printf("parallel %8.3f ms  err %g\n", 1000 * t, svdBatchError(m, u, s, v));
+	}
+}
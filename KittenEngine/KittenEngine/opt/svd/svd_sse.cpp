@@ -0,0 +1,9 @@
+#include "../svd.h"
+#include <immintrin.h>
+
+#define USE_SSE_IMPLEMENTATION
+#define SVD_BATCH_NAME svdSSE
+#define SVD_BATCH_WIDTH 4
+#define SVD_BATCH_LOAD _mm_load_ps
+#define SVD_BATCH_STORE _mm_store_ps
+#include "svd_batch.hpp"
@@ -10,7 +10,7 @@ using namespace std;
 //****************************************************************************80
 
 double best_nearby ( double delta[], double point[], double prevbest, 
-  int nvars, std::function<double(double[], int)> f, int *funevals )
+  int nvars, function_ref<double(double[], int)> f, int *funevals )
 
 //****************************************************************************80
 //
@@ -128,7 +128,7 @@ double best_nearby ( double delta[], double point[], double prevbest,
 //****************************************************************************80
 
 int hooke ( int nvars, double startpt[], double endpt[], double rho, double eps, 
-  int itermax, std::function<double(double[], int)> f)   
+  int itermax, function_ref<double(double[], int)> f)   
 
 //****************************************************************************80
 //
@@ -434,3 +434,18 @@ int hooke ( int nvars, double startpt[], double endpt[], double rho, double eps,
   return iters;
 }
 //****************************************************************************80
+
+int hooke ( int nvars, double startpt[], double endpt[], double rho, double eps, 
+  int itermax, std::function<double(double[], int)> f )
+
+//****************************************************************************80
+//
+//  Purpose:
+//
+//    HOOKE overload taking a std::function. Forwards to the function_ref version.
+//
+{
+  return hooke ( nvars, startpt, endpt, rho, eps, itermax, 
+    function_ref<double(double[], int)> ( f ) );
+}
+//****************************************************************************80
@@ -1,7 +1,20 @@
+#pragma once
 #include <functional>
+#include "function_ref.h"
 #include "math.h"
 
 double best_nearby ( double delta[], double point[], double prevbest, 
-  int nvars, std::function<double(double[], int)>, int *funevals );
+  int nvars, function_ref<double(double[], int)>, int *funevals );
+int hooke ( int nvars, double startpt[], double endpt[], double rho, double eps, 
+  int itermax, function_ref<double(double[], int)> );
 int hooke ( int nvars, double startpt[], double endpt[], double rho, double eps, 
   int itermax, std::function<double(double[], int)> );
+
+// Any other callable is passed by reference without going through std::function
+template <typename F>
+int hooke ( int nvars, double startpt[], double endpt[], double rho, double eps, 
+  int itermax, F&& f )
+{
+  return hooke ( nvars, startpt, endpt, rho, eps, itermax, 
+    function_ref<double(double[], int)> ( f ) );
+}
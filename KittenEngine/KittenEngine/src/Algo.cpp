@@ -1,161 +1,189 @@
 #include "../includes/modules/Algo.h"
+#include "../includes/modules/SpatialHashmap.h"
+#include <unordered_map>
 
 using namespace Eigen;
 
 std::vector<glm::vec3> Kitten::bluenoiseSample(vector<glm::vec3>& samples, int N) {
 	using namespace glm;
 	using namespace std;
+	const int M = (int)samples.size();
+	N = std::min(N, M);
 	vector<vec3> newSamples;
+	if (N <= 0) return newSamples;
 	newSamples.reserve(N);
-	newSamples.push_back(samples.back());
-	samples.pop_back();
 
-	vector<float> closestDist(samples.size(), std::numeric_limits<float>::infinity());
+	// Squared distance of every candidate to the picked set
+	vector<float> closestDist(M);
+	vector<char> picked(M, 0);
+	const vec3 first = samples.back();
+	picked[M - 1] = 1;
+	newSamples.push_back(first);
 
-	for (int i = 1; i < N; i++) {
-		float maxDist = 0;
-		int furthestIdx = -1;
+#pragma omp parallel for schedule(static, 4096)
+	for (int j = 0; j < M; j++)
+		closestDist[j] = length2(samples[j] - first);
+
+	// Lazy max heap. Entries go stale as distances shrink and are refreshed when popped.
+	// Ties go to the lowest index, the same as a linear scan for the farthest.
+	auto closer = [](const pair<float, int>& a, const pair<float, int>& b) {
+		return a.first < b.first || (a.first == b.first && a.second > b.second);
+		};
+	vector<pair<float, int>> heap(M - 1);
+	for (int j = 0; j < M - 1; j++)
+		heap[j] = { closestDist[j], j };
+	std::make_heap(heap.begin(), heap.end(), closer);
+
+	// Only candidates within the current max distance of a new pick can get closer.
+	// The grid is rebuilt with a cell size of that distance every time it halves.
+	// Until there are enough picks for the cells to be sparse, all candidates are updated instead.
+	SpatialHashmap<int>* grid = nullptr;
+	float gridCellSize = std::numeric_limits<float>::infinity();
+
+	while ((int)newSamples.size() < N) {
+		std::pop_heap(heap.begin(), heap.end(), closer);
+		const pair<float, int> top = heap.back();
+		heap.pop_back();
+
+		const int j = top.second;
+		if (picked[j]) continue;
+		if (top.first != closestDist[j]) {
+			heap.push_back({ closestDist[j], j });
+			std::push_heap(heap.begin(), heap.end(), closer);
+			continue;
+		}
 
-		vec3 lastPicked = newSamples.back();
-		for (int j = 0; j < samples.size(); j++) {
-			vec3 p = samples[j];
+		picked[j] = 1;
+		const vec3 p = samples[j];
+		newSamples.push_back(p);
+		const float maxDist = sqrt(top.first);
 
-			float nd = length2(p - lastPicked);
-			float minDist = closestDist[j];
-			if (nd < minDist)
-				closestDist[j] = minDist = nd;
+		if (maxDist < 0.5f * gridCellSize && maxDist > 0 && 256 * newSamples.size() >= (size_t)M) {
+			delete grid;
+			gridCellSize = maxDist;
+			grid = new SpatialHashmap<int>(heap.size() + 1, gridCellSize);
+#pragma omp parallel for schedule(static, 4096)
+			for (int k = 0; k < M; k++)
+				if (!picked[k] && closestDist[k] > 0)
+					grid->add(samples[k], k);
+		}
 
-			if (minDist > maxDist) {
-				maxDist = minDist;
-				furthestIdx = j;
+		if (grid)
+			for (auto itr = grid->getNeighbors(p); itr != grid->end(); ++itr) {
+				const int k = *itr;
+				closestDist[k] = std::min(closestDist[k], length2(samples[k] - p));
 			}
+		else {
+#pragma omp parallel for schedule(static, 4096)
+			for (int k = 0; k < M; k++)
+				closestDist[k] = std::min(closestDist[k], length2(samples[k] - p));
 		}
-
-		newSamples.push_back(samples[furthestIdx]);
-		std::swap(samples[furthestIdx], samples.back());
-		samples.pop_back();
-		std::swap(closestDist[furthestIdx], closestDist.back());
-		closestDist.pop_back();
 	}
+	delete grid;
+
+	// Remove the picked samples while keeping the rest in order
+	int numLeft = 0;
+	for (int j = 0; j < M; j++)
+		if (!picked[j]) samples[numLeft++] = samples[j];
+	samples.resize(numLeft);
+
 	return newSamples;
 }
 
-std::vector<float> Kitten::polylineUniformSample(std::function<vec3(float)> f, float a, float b, const int numSamples, const int numItr, const float learningRate) {
-	std::vector<float> ts(numSamples);
-	for (size_t i = 0; i < numSamples; i++)
-		ts[i] = glm::mix(a, b, i / (float)(numSamples - 1));
-
-	vec3 root = f(a);
-	for (size_t k = 0; k < numItr; k++) {
-		float lt = a;
-		vec3 left = root;
-		float mt = ts[1];
-		vec3 mid = f(mt);
-
-		for (size_t i = 1; i < numSamples - 1; i++) {
-			vec3 right = f(ts[i + 1]);
-			float rt = ts[i + 1];
-
-			// (t - lt) / (mt - lt) * leftL = (1 - (t - mt) / (rt - mt)) * rightL
-			// (t - lt) lr = (rt - t) rr
-			float lr = length(left - mid) / (mt - lt);
-			float rr = length(right - mid) / (rt - mt);
-
-			float episilon = (rt - lt) * 1e-2f;
-			float nt = lr + rr != 0 ? glm::clamp((lt * lr + rt * rr) / (lr + rr), lt + episilon, rt - episilon) : 0.5f * (lt + rt);
-			ts[i] = mt = glm::mix(mt, nt, learningRate);
-			mid = f(mt);
-
-			left = mid;
-			mid = right;
-			lt = mt;
-			mt = rt;
+std::vector<glm::vec3> Kitten::poissonDiskSample(const vector<glm::vec3>& samples, const float radius) {
+	using namespace glm;
+	using namespace std;
+	const int M = (int)samples.size();
+	if (M == 0) return {};
+
+	// Bin candidates into cells of size radius. Only the 27 neighboring cells can conflict.
+	const float invRadius = 1 / radius;
+	auto cellKey = [](ivec3 c) {
+		return (uint64_t)(c.x & 0x1fffff) | ((uint64_t)(c.y & 0x1fffff) << 21) | ((uint64_t)(c.z & 0x1fffff) << 42);
+		};
+	vector<ivec3> cells(M);
+#pragma omp parallel for schedule(static, 4096)
+	for (int j = 0; j < M; j++)
+		cells[j] = ivec3(floor(samples[j] * invRadius));
+
+	// Candidates are tried in a hashed order within each cell so the result is random looking
+	// yet independent of the thread count.
+	auto priority = [&](int j) -> uint32_t {
+		uint32_t h = (uint32_t)j * 0x9e3779b9u;
+		h ^= h >> 16;
+		h *= 0x85ebca6bu;
+		h ^= h >> 13;
+		return h;
+		};
+	vector<int> order(M);
+	for (int j = 0; j < M; j++) order[j] = j;
+	std::sort(order.begin(), order.end(), [&](int a, int b) {
+		const uint64_t ka = cellKey(cells[a]), kb = cellKey(cells[b]);
+		if (ka != kb) return ka < kb;
+		return priority(a) < priority(b);
+		});
+
+	// Cell ranges within order and the accepted points of each cell
+	vector<int> cellStart;
+	unordered_map<uint64_t, int> cellIndex;
+	for (int i = 0; i < M; i++)
+		if (i == 0 || cellKey(cells[order[i]]) != cellKey(cells[order[i - 1]])) {
+			cellIndex[cellKey(cells[order[i]])] = (int)cellStart.size();
+			cellStart.push_back(i);
+		}
+	const int numCells = (int)cellStart.size();
+	cellStart.push_back(M);
+	vector<vector<vec3>> accepted(numCells);
+
+	// The last sample is accepted before anything else
+	accepted[cellIndex[cellKey(cells[M - 1])]].push_back(samples[M - 1]);
+
+	// Cells of the same parity are at least a radius apart so each parity class is done in parallel
+	const float r2 = radius * radius;
+	for (int phase = 0; phase < 8; phase++) {
+#pragma omp parallel for schedule(dynamic, 64)
+		for (int c = 0; c < numCells; c++) {
+			const ivec3 cell = cells[order[cellStart[c]]];
+			if (((cell.x & 1) | ((cell.y & 1) << 1) | ((cell.z & 1) << 2)) != phase) continue;
+
+			for (int i = cellStart[c]; i < cellStart[c + 1]; i++) {
+				if (order[i] == M - 1) continue;
+				const vec3 p = samples[order[i]];
+				bool ok = true;
+				for (int dz = -1; dz <= 1 && ok; dz++)
+					for (int dy = -1; dy <= 1 && ok; dy++)
+						for (int dx = -1; dx <= 1 && ok; dx++) {
+							auto itr = cellIndex.find(cellKey(cell + ivec3(dx, dy, dz)));
+							if (itr == cellIndex.end()) continue;
+							for (auto& q : accepted[itr->second])
+								if (length2(p - q) < r2) {
+									ok = false;
+									break;
+								}
+						}
+				if (ok) accepted[c].push_back(p);
+			}
 		}
 	}
 
-	return ts;
+	vector<vec3> newSamples;
+	for (auto& a : accepted)
+		newSamples.insert(newSamples.end(), a.begin(), a.end());
+	return newSamples;
+}
+
+std::vector<float> Kitten::polylineArcLengthSample(std::function<vec3(float)> f, float a, float b, const int numSamples, const float tol) {
+	return polylineArcLengthSample<std::function<vec3(float)>&>(f, a, b, numSamples, tol);
+}
+
+std::vector<float> Kitten::polylineUniformSample(std::function<vec3(float)> f, float a, float b, const int numSamples, const int numItr, const float learningRate) {
+	return polylineArcLengthSample(f, a, b, numSamples);
 }
 
 Eigen::VectorXf Kitten::lbfgsMin(int numVars, std::function<float(Eigen::VectorXf)> f,
 	std::function<Eigen::VectorXf(Eigen::VectorXf)> g,
 	Eigen::VectorXf& guess, const float tol, const int m) {
-	using namespace Eigen;
-
-	MatrixXf s(numVars, m);
-	MatrixXf y(numVars, m);
-	VectorXf rho(m);
-	VectorXf a(m);
-
-	int buffSize = 0;
-	int buffInd = 0;
-
-	VectorXf lastX = guess;
-	VectorXf lastGv = g(guess);
-	VectorXf x = guess - 0.001f * lastGv;
-	float fv = f(x);
-	VectorXf gv;
-	VectorXf z;
-	int itr = 0;
-	while (true) {
-		itr++;
-
-		const int ind = buffInd % m;
-
-		// Find descent direction with lbfgs
-
-		gv = g(x);
-		float k = (gv - lastGv).dot(x - lastX);
-		if (k <= 0) {
-			x -= 0.001f * gv;
-			if (gv.norm() < tol) break;
-			continue;
-		}
-
-		s.col(ind) = x - lastX;
-		y.col(ind) = gv - lastGv;
-		rho[ind] = 1 / k;
-
-		lastX = x;
-		lastGv = gv;
-		z = gv;
-		buffSize = std::min(m, buffSize + 1);
-
-		for (int i = 0; i < buffSize; i++) {
-			const int oi = (buffInd + m - i) % m;
-			a[oi] = rho[oi] * z.dot(s.col(oi));
-			z -= a[oi] * y.col(oi);
-		}
-
-		float Y = y.col(ind).dot(y.col(ind));
-		if (Y != 0) {
-			Y = s.col(ind).dot(y.col(ind)) / Y;
-			z *= Y;
-		}
-		for (int i = 0; i < buffSize; i++) {
-			const int oi = (buffInd + m + i - buffSize + 1) % m;
-			z += s.col(oi) * (a[oi] - rho[oi] * y.col(oi).dot(z));
-		}
-
-		z *= -1;
-		// Perform backtracking line search
-		float t = 0.5f * gv.dot(z);
-		float a = 1.f;
-		float v = f(x);
-		while (f(x + a * z) > v + a * t)
-			a *= 0.5f;
-
-		// Update guess
-		x += a * z;
-		float newFv = f(x);
-		float diff = newFv - fv;
-		fv = newFv;
-
-		buffInd++;
-
-		if (gv.norm() < tol && abs(diff) < tol) break;
-	}
-	// printf("ITR: %d\n", itr);
-	return x;
+	return lbfgsMin<std::function<float(Eigen::VectorXf)>&, std::function<Eigen::VectorXf(Eigen::VectorXf)>&>(numVars, f, g, guess, tol, m);
 }
 
 Eigen::VectorXd Kitten::cg(
@@ -204,24 +232,270 @@ Eigen::VectorXd Kitten::cg(
 	return x;
 }
 
+Eigen::VectorXd Kitten::cg(
+	std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> A,
+	Eigen::VectorXd& invDiag,
+	Eigen::VectorXd& b,
+	const double tol,
+	const int itrLim,
+	int* numItr) {
+
+	VectorXd x = VectorXd::Zero(b.size());
+	VectorXd r = b;
+	VectorXd d = invDiag.array() * r.array();
+
+	VectorXd q(x.size());
+	VectorXd s(x.size());
+
+	const int UPDATE_ITR = std::max(100, (int)sqrt((double)b.size()));
+	double rDotD[2] = { r.dot(d), 0 };
+	const double relTol = tol * tol * rDotD[0];
+	int itr = 1;
+	for (; (itrLim < 0 || itr <= itrLim) && rDotD[0] > relTol; itr++) {
+		A(d, q);
+		double dDotQ = d.dot(q);
+		if (dDotQ <= 0) {
+			// Non-positive curvature. Fall back to the preconditioned residual if we have nothing yet.
+			if (itr == 1) x = d;
+			break;
+		}
+
+		double alpha = rDotD[0] / dDotQ;
+		x += alpha * d;
+
+		if (itr % UPDATE_ITR == 0) {
+			A(x, q);
+			r = b - q;
+		}
+		else
+			r -= alpha * q;
+
+		s = invDiag.array() * r.array();
+		rDotD[1] = rDotD[0];
+		rDotD[0] = r.dot(s);
+		double beta = rDotD[0] / rDotD[1];
+		d = s + beta * d;
+	}
+	if (numItr) *numItr = itr - 1;
+
+	return x;
+}
+
+// Inner iterations are always capped as bccg() has no safeguard against indefinite hessians
+static int cgItrLim(const Kitten::NewtonParams& params, const VectorXd& x) {
+	return params.cgItrLim < 0 ? std::max(100, 2 * (int)x.size()) : params.cgItrLim;
+}
+
+// The shared outer loop of both newtonMin() variants.
+// solve(x, g, free, eta, d) computes the step d and returns the number of CG iterations used.
+// free is 1 for free variables and 0 for variables actively held at the lower bound.
+static VectorXd newtonLoop(
+	std::function<double(const VectorXd&)>& f,
+	std::function<VectorXd(const VectorXd&)>& g,
+	std::function<int(const VectorXd&, const VectorXd&, const VectorXd&, double, VectorXd&)> solve,
+	const VectorXd& guess,
+	const Kitten::NewtonParams& params,
+	Kitten::NewtonStats* stats) {
+
+	Kitten::NewtonStats st;
+	const VectorXd* lower = params.lower;
+
+	VectorXd x = guess;
+	if (lower) x = x.cwiseMax(*lower);
+
+	double fx = f(x);
+	st.numFEvals++;
+
+	VectorXd gv, d, xn;
+	VectorXd free = VectorXd::Ones(x.size());
+	double eta = params.etaMax;
+	double lastGradNorm = 0;
+
+	for (; st.itr < params.itrLim; st.itr++) {
+		gv = g(x);
+		st.numGEvals++;
+
+		// Update the active set and check the projected gradient
+		if (lower) {
+#pragma omp parallel for schedule(static, 4096)
+			for (int i = 0; i < x.size(); i++)
+				free[i] = (x[i] <= (*lower)[i] && gv[i] > 0) ? 0. : 1.;
+		}
+
+		st.gradNorm = (gv.array() * free.array()).matrix().norm();
+		if (st.gradNorm < params.tol) {
+			st.converged = true;
+			break;
+		}
+
+		// Eisenstat-Walker forcing term
+		if (st.itr > 0) {
+			const double safeguard = params.ewGamma * pow(eta, params.ewAlpha);
+			eta = params.ewGamma * pow(st.gradNorm / lastGradNorm, params.ewAlpha);
+			if (safeguard > 0.1) eta = std::max(eta, safeguard);
+			eta = glm::clamp(eta, params.etaMin, params.etaMax);
+		}
+		lastGradNorm = st.gradNorm;
+
+		// Solve for the Newton step
+		const int cgItr = solve(x, gv, free, eta, d);
+		st.cgItr += cgItr;
+		st.numHEvals++;
+
+		// Fall back to gradient descent if this is not a descent direction
+		if (!(gv.dot(d) < 0))
+			d = -(gv.array() * free.array()).matrix();
+
+		// Projected backtracking line search
+		double a = 1;
+		double fn = fx;
+		bool accepted = false;
+		for (int k = 0; k < params.lineSearchLim; k++, a *= params.backtrack) {
+			xn = x + a * d;
+			if (lower) xn = xn.cwiseMax(*lower);
+			fn = f(xn);
+			st.numFEvals++;
+			if (fn <= fx + params.armijo * gv.dot(xn - x)) {
+				accepted = true;
+				break;
+			}
+		}
+
+		if (params.verbose)
+			printf("newton %d: f=%.6e |g|=%.3e eta=%.2e cg=%d a=%.2e\n", st.itr, fn, st.gradNorm, eta, cgItr, a);
+
+		// The line search stalled
+		if (!accepted) break;
+
+		x.swap(xn);
+		fx = fn;
+		st.energy.push_back(fx);
+	}
+
+	st.f = fx;
+	if (stats) *stats = st;
+	return x;
+}
+
+Eigen::VectorXd Kitten::newtonMin(
+	std::function<double(const Eigen::VectorXd&)> f,
+	std::function<Eigen::VectorXd(const Eigen::VectorXd&)> g,
+	std::function<Eigen::SparseMatrix<double, Eigen::RowMajor>(const Eigen::VectorXd&)> H,
+	const Eigen::VectorXd& guess,
+	const NewtonParams& params,
+	NewtonStats* stats) {
+
+	auto solve = [&](const VectorXd& x, const VectorXd& gv, const VectorXd& free, double eta, VectorXd& d) {
+		SparseMatrix<double, RowMajor> A = H(x);
+		VectorXd b = -gv;
+		int itr = 0;
+
+		if (params.lower) {
+			// Pin the active set by replacing their rows and columns with identity.
+			// bccg() then keeps x + d above the lower bound for everything else.
+			A.prune([&](const Index& row, const Index& col, const double&) {
+				return row == col || (free[row] != 0 && free[col] != 0);
+				});
+			A.makeCompressed();
+
+			// Pruned active rows hold at most their diagonal. Missing ones are added in one rebuild.
+			bool missingDiag = false;
+			for (int i = 0; i < A.rows(); i++)
+				if (free[i] == 0) {
+					const int start = A.outerIndexPtr()[i];
+					if (A.outerIndexPtr()[i + 1] > start) A.valuePtr()[start] = 1;
+					else missingDiag = true;
+				}
+			if (missingDiag) {
+				std::vector<Triplet<double>> entries;
+				entries.reserve(A.nonZeros() + A.rows());
+				for (int i = 0; i < A.outerSize(); i++) {
+					for (SparseMatrix<double, RowMajor>::InnerIterator it(A, i); it; ++it)
+						entries.emplace_back((int)it.row(), (int)it.col(), it.value());
+					if (free[i] == 0 && A.outerIndexPtr()[i + 1] == A.outerIndexPtr()[i])
+						entries.emplace_back(i, i, 1.);
+				}
+				A.setFromTriplets(entries.begin(), entries.end());
+			}
+			b.array() *= free.array();
+
+			// Skip the warm start so every inner iteration is capped and counted
+			VectorXd lower = *params.lower - x;
+			d = bccg(A, b, lower, eta, cgItrLim(params, x), &itr, false);
+			return itr;
+		}
+
+		// The hessian may be indefinite away from the minimum so keep the preconditioner positive
+		VectorXd invDiag(A.rows());
+#pragma omp parallel for schedule(static, 512)
+		for (int i = 0; i < invDiag.size(); i++) {
+			double v = abs(A.coeff(i, i));
+			invDiag[i] = v < 1e-10 ? 1 : 1 / v;
+		}
+
+		d = cg([&](const VectorXd& v, VectorXd& Av) { Av = A * v; }, invDiag, b, eta, cgItrLim(params, x), &itr);
+		return itr;
+		};
+
+	return newtonLoop(f, g, solve, guess, params, stats);
+}
+
+Eigen::VectorXd Kitten::newtonMin(
+	std::function<double(const Eigen::VectorXd&)> f,
+	std::function<Eigen::VectorXd(const Eigen::VectorXd&)> g,
+	std::function<void(const Eigen::VectorXd&, const Eigen::VectorXd&, Eigen::VectorXd&)> Hv,
+	std::function<Eigen::VectorXd(const Eigen::VectorXd&)> diagH,
+	const Eigen::VectorXd& guess,
+	const NewtonParams& params,
+	NewtonStats* stats) {
+
+	auto solve = [&](const VectorXd& x, const VectorXd& gv, const VectorXd& free, double eta, VectorXd& d) {
+		VectorXd invDiag;
+		if (diagH) {
+			invDiag = diagH(x);
+#pragma omp parallel for schedule(static, 512)
+			for (int i = 0; i < invDiag.size(); i++)
+				invDiag[i] = abs(invDiag[i]) < 1e-10 ? 1 : 1 / abs(invDiag[i]);
+		}
+		else invDiag = VectorXd::Ones(x.size());
+
+		// Solve the reduced system over the free variables
+		VectorXd b = -(gv.array() * free.array()).matrix();
+		int itr = 0;
+		d = cg([&](const VectorXd& v, VectorXd& Av) {
+			Hv(x, v, Av);
+			if (params.lower) Av.array() *= free.array();
+			}, invDiag, b, eta, cgItrLim(params, x), &itr);
+		return itr;
+		};
+
+	return newtonLoop(f, g, solve, guess, params, stats);
+}
+
 Eigen::VectorXd Kitten::bccg(
 	Eigen::SparseMatrix<double, Eigen::RowMajor>& A,
 	Eigen::VectorXd& b,
 	Eigen::VectorXd& lower,
 	const double tol,
-	const int itrLim) {
+	const int itrLim,
+	int* numItr,
+	const bool warmStart) {
 
 	// Initialize preconditioner
 	VectorXd invDiag(A.rows());
 	//VectorXd x(invDiag.size());
 	VectorXd x;
+	int warmItr = 0;
 
-	{
+	if (warmStart) {
 		ConjugateGradient<SparseMatrix<double, RowMajor>, Lower | Upper, DiagonalPreconditioner<double>> cg;
 		cg.setTolerance(512 * tol);
+		if (itrLim >= 0) cg.setMaxIterations(itrLim);
 		cg.compute(A);
 		x = cg.solve(b);
+		warmItr = (int)cg.iterations();
 	}
+	else x = VectorXd::Zero(b.size());
 
 #pragma omp parallel for schedule(static, 512)
 	for (int i = 0; i < x.size(); i++) {
@@ -255,9 +529,11 @@ Eigen::VectorXd Kitten::bccg(
 	bool boundsChanged = false;
 	int itrSinceRes = 0;
 	const int UPDATE_ITR = std::max(100, (int)sqrt(A.cols()));
+	// The warm start shares the itrLim budget so one call never takes more than itrLim iterations
+	const int bcLim = itrLim < 0 ? -1 : std::max(0, itrLim - warmItr);
 
 	size_t itr = 1;
-	for (; (itrLim < 0 || itr <= itrLim) && (rDotD[0] > relTol || boundsChanged || haveUnreleased); itr++, itrSinceRes++) {
+	for (; (bcLim < 0 || itr <= bcLim) && (rDotD[0] > relTol || boundsChanged || haveUnreleased); itr++, itrSinceRes++) {
 		q = A * d;
 		double alpha = rDotD[0] / d.dot(q);
 		x += alpha * d;
@@ -310,6 +586,7 @@ Eigen::VectorXd Kitten::bccg(
 		}
 	}
 	// printf("%zd\n", itr);
+	if (numItr) *numItr = (int)itr - 1 + warmItr;
 	delete[] boundSet;
 	return x;
 }
@@ -0,0 +1,90 @@
+#include "../includes/modules/BoundArray.h"
+#include "../includes/modules/Mesh.h"
+#include "../includes/modules/StopWatch.h"
+#include <random>
+
+namespace Kitten {
+	BoundArray<3> meshBounds(const std::vector<Mesh*>& meshes) {
+		BoundArray<3> arr;
+		arr.build(meshes.size(), [&](size_t i) { return meshes[i]->bounds; });
+		return arr;
+	}
+
+	BoundArray<3> triangleBounds(const Mesh& mesh, const float padding) {
+		BoundArray<3> arr;
+		const Vertex* verts = mesh.vertices.data();
+		const unsigned int* tris = mesh.indices.data();
+		arr.build(mesh.indices.size() / 3, [&](size_t i) {
+			Bound<> b(verts[tris[3 * i]].pos);
+			b.absorb(verts[tris[3 * i + 1]].pos);
+			b.absorb(verts[tris[3 * i + 2]].pos);
+			b.pad(padding);
+			return b;
+			});
+		return arr;
+	}
+
+	void boundArrayBenchmark(int n) {
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dist(0, 1);
+
+		std::vector<Bound<>> bounds(n);
+		for (int i = 0; i < n; i++) {
+			const vec3 c(dist(rng), dist(rng), dist(rng));
+			const vec3 h = 0.01f * vec3(dist(rng), dist(rng), dist(rng));
+			bounds[i] = Bound<>(c - h, c + h);
+		}
+
+		const Bound<> q(vec3(0.3f), vec3(0.5f));
+		// The boxes are small so the point query uses a center to be sure of hits
+		const vec3 p = n > 0 ? bounds[0].center() : vec3(0.5f);
+		const vec3 o(0.01f, 0.02f, 0.03f), dir = normalize(vec3(1, 0.9f, 0.8f));
+		const float tMax = 2;
+		auto rayHit = [&](const Bound<>& b) {
+			const vec3 t0 = (b.min - o) / dir, t1 = (b.max - o) / dir;
+			const vec3 tn = glm::min(t0, t1), tf = glm::max(t0, t1);
+			return glm::max(0.f, glm::max(tn.x, glm::max(tn.y, tn.z))) <= glm::min(tMax, glm::min(tf.x, glm::min(tf.y, tf.z)));
+			};
+
+		printf("bound array benchmark: n = %d\n", n);
+		StopWatch timer;
+		timer.gpuSync = false;
+
+		timer.reset();
+		BoundArray<3> arr(bounds);
+		timer.time();
+		printf("build        %8.3f ms\n", 1000 * timer.deltaTimes.back());
+
+		std::vector<int> ref, hits;
+		for (int op = 0; op < 4; op++) {
+			static const char* names[] = { "overlapping", "containedIn", "containing", "raycast" };
+
+			timer.reset();
+			ref.clear();
+			for (int i = 0; i < n; i++) {
+				bool hit = false;
+				switch (op) {
+				case 0: hit = bounds[i].intersects(q); break;
+				case 1: hit = q.contains(bounds[i]); break;
+				case 2: hit = bounds[i].contains(p); break;
+				case 3: hit = rayHit(bounds[i]); break;
+				}
+				if (hit) ref.push_back(i);
+			}
+			timer.time();
+			const double tScalar = timer.deltaTimes.back();
+
+			timer.reset();
+			switch (op) {
+			case 0: arr.overlapping(q, hits); break;
+			case 1: arr.containedIn(q, hits); break;
+			case 2: arr.containing(p, hits); break;
+			case 3: arr.raycast(o, dir, tMax, hits); break;
+			}
+			timer.time();
+
+			printf("%-12s scalar %8.3f ms  batched %8.3f ms  hits %zd %s\n", names[op],
+				1000 * tScalar, 1000 * timer.deltaTimes.back(), hits.size(), hits == ref ? "match" : "MISMATCH");
+		}
+	}
+}
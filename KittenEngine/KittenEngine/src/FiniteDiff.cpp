@@ -0,0 +1,350 @@
+#include "../includes/modules/Algo.h"
+#include <random>
+
+using namespace Eigen;
+
+namespace {
+	typedef std::function<void(const VectorXd&, VectorXd&)> ResidualFunc;
+
+	// The number of colors whose stencil points are evaluated together.
+	// Bounds the scratch memory to 4 * COLOR_BATCH residual vectors.
+	constexpr int COLOR_BATCH = 16;
+
+	// Same 4 point stencil as nDiff()
+	constexpr double STENCIL_OFFSET[4] = { -2, -1, 1, 2 };
+	constexpr double STENCIL_WEIGHT[4] = { 1, -8, 8, -1 };
+
+	// Evaluates every stencil point of colors [c0, c0 + nb) in parallel.
+	// R[4 * (c - c0) + s] holds stencil point s of color c.
+	void evalColors(ResidualFunc& f, const VectorXd& x, const std::vector<std::vector<int>>& colorCols,
+		const int c0, const int nb, const double h, std::vector<VectorXd>& R) {
+#pragma omp parallel for schedule(dynamic, 1)
+		for (int k = 0; k < 4 * nb; k++) {
+			VectorXd xp = x;
+			const double offset = STENCIL_OFFSET[k % 4] * h;
+			for (int j : colorCols[c0 + k / 4])
+				xp[j] += offset;
+			f(xp, R[k]);
+		}
+	}
+
+	inline double stencil(const std::vector<VectorXd>& R, const int k, const int row, const double invH) {
+		double v = 0;
+		for (int s = 0; s < 4; s++)
+			v += STENCIL_WEIGHT[s] * R[k + s][row];
+		return v * invH;
+	}
+
+	struct JacobianEntry {
+		int row, col;
+		double given, numerical, err;
+	};
+
+	// Prints the results of a jacobian check in the same style as checkJacobian<N, M>()
+	bool reportJacobian(const int M, const int N, const int numEvals, std::vector<JacobianEntry>& entries, const double tol) {
+		const double secondaryTol = Kitten::pow2(tol);
+
+		double maxErr = 0;
+		bool good = true;
+		bool flipped = false;
+		for (auto& e : entries) {
+			e.err = Kitten::relError(e.given, e.numerical);
+			if (e.err > tol) {
+				good = false;
+				if (Kitten::relError(-e.given, e.numerical) <= tol) flipped = true;
+			}
+			maxErr = glm::max(maxErr, e.err);
+		}
+
+		auto setColor = [&](double err, bool numerical) {
+			if (err > tol) printf(numerical ? "\033[32m" : "\033[31m");
+			else if (err > secondaryTol && !numerical) printf("\033[33m");
+			if (err == maxErr) printf("\033[1m");
+		};
+
+		if (M <= 12 && N <= 12) {
+			// Small enough to print everything
+			MatrixXd given = MatrixXd::Zero(M, N), numerical = MatrixXd::Zero(M, N), err = MatrixXd::Zero(M, N);
+			for (auto& e : entries) {
+				given(e.row, e.col) = e.given;
+				numerical(e.row, e.col) = e.numerical;
+				err(e.row, e.col) = e.err;
+			}
+
+			const char* titles[3] = { "Given jacobian:", "Numerical jacobian (ground truth):", "Relative err:" };
+			for (int t = 0; t < 3; t++) {
+				printf("%s\n", titles[t]);
+				for (int k = 0; k < M; k++) {
+					printf("%2d: ", k);
+					for (int i = 0; i < N; i++) {
+						setColor(err(k, i), t == 1);
+						if (t == 0) printf("%10f \033[0m", given(k, i));
+						else if (t == 1) printf("%10f \033[0m", numerical(k, i));
+						else if (err(k, i) == 0) printf("%10d \033[0m", 0);
+						else printf("%10.2e \033[0m", err(k, i));
+					}
+					printf("\n");
+				}
+				printf("\n");
+			}
+		}
+		else if (!good) {
+			// Only print the worst entries
+			const int numPrint = (int)std::min(entries.size(), (size_t)16);
+			std::partial_sort(entries.begin(), entries.begin() + numPrint, entries.end(),
+				[](const JacobianEntry& a, const JacobianEntry& b) { return a.err > b.err; });
+
+			printf("Worst entries (row, col): given numerical (relative err)\n");
+			for (int i = 0; i < numPrint && entries[i].err > secondaryTol; i++) {
+				auto& e = entries[i];
+				printf("(%6d, %6d): ", e.row, e.col);
+				setColor(e.err, false);
+				printf("%10f \033[0m", e.given);
+				setColor(e.err, true);
+				printf("%10f \033[0m", e.numerical);
+				setColor(e.err, false);
+				printf("(%.2e)\033[0m\n", e.err);
+			}
+			printf("\n");
+		}
+
+		printf("Checked %zd entries with %d evaluations\n", entries.size(), numEvals);
+		printf("Max error: ");
+		if (maxErr > tol) printf("\033[1;31m");
+		else if (maxErr > secondaryTol) printf("\033[1;33m");
+		printf("%10.3e \033[0m\n", maxErr);
+
+		if (flipped) printf("\033[1;31mFlipped sign??\033[0m\n");
+
+		if (good)
+			printf("\n\033[1;32mAll pass!\033[0m\n");
+		else
+			printf("\n\033[1;31m=====    SOMETHING IS WRONG!!!!!!!!!!!    =====\033[0m\n");
+		printf("End jacobian test.\n");
+
+		return good;
+	}
+}
+
+int Kitten::colorJacobian(const SparseMatrix<double, RowMajor>& pattern, std::vector<int>& colors) {
+	const int numCols = (int)pattern.cols();
+	SparseMatrix<double, ColMajor> colPattern = pattern;
+
+	colors.assign(numCols, -1);
+	// forbidden[c] == j marks color c as taken by a neighbor of column j
+	std::vector<int> forbidden;
+	int numColors = 0;
+
+	for (int j = 0; j < numCols; j++) {
+		for (SparseMatrix<double, ColMajor>::InnerIterator it(colPattern, j); it; ++it)
+			for (SparseMatrix<double, RowMajor>::InnerIterator jt(pattern, it.row()); jt; ++jt) {
+				const int c = colors[jt.col()];
+				if (c >= 0) forbidden[c] = j;
+			}
+
+		int c = 0;
+		while (c < numColors && forbidden[c] == j) c++;
+		if (c == numColors) {
+			numColors++;
+			forbidden.push_back(-1);
+		}
+		colors[j] = c;
+	}
+
+	return numColors;
+}
+
+Eigen::MatrixXd Kitten::nJacobian(ResidualFunc f, const VectorXd& x, const int numResiduals, const double h) {
+	const int numCols = (int)x.size();
+	const double invH = 1 / (12 * h);
+
+	// Every column gets its own color
+	std::vector<std::vector<int>> colorCols(numCols);
+	for (int j = 0; j < numCols; j++)
+		colorCols[j].push_back(j);
+
+	MatrixXd J(numResiduals, numCols);
+	std::vector<VectorXd> R(4 * COLOR_BATCH, VectorXd::Zero(numResiduals));
+
+	for (int c0 = 0; c0 < numCols; c0 += COLOR_BATCH) {
+		const int nb = std::min(COLOR_BATCH, numCols - c0);
+		evalColors(f, x, colorCols, c0, nb, h, R);
+
+#pragma omp parallel for schedule(static, 1)
+		for (int c = 0; c < nb; c++)
+			for (int i = 0; i < numResiduals; i++)
+				J(i, c0 + c) = stencil(R, 4 * c, i, invH);
+	}
+
+	return J;
+}
+
+Eigen::SparseMatrix<double, RowMajor> Kitten::nJacobian(ResidualFunc f, const VectorXd& x,
+	const SparseMatrix<double, RowMajor>& pattern, const double h) {
+	const double invH = 1 / (12 * h);
+
+	std::vector<int> colors;
+	const int numColors = colorJacobian(pattern, colors);
+	std::vector<std::vector<int>> colorCols(numColors);
+	for (int j = 0; j < (int)colors.size(); j++)
+		colorCols[colors[j]].push_back(j);
+
+	SparseMatrix<double, RowMajor> J = pattern;
+	J.makeCompressed();
+	std::vector<VectorXd> R(4 * COLOR_BATCH, VectorXd::Zero(pattern.rows()));
+
+	for (int c0 = 0; c0 < numColors; c0 += COLOR_BATCH) {
+		const int nb = std::min(COLOR_BATCH, numColors - c0);
+		evalColors(f, x, colorCols, c0, nb, h, R);
+
+		// Columns of the same color never share a row so each entry only sees its own column
+#pragma omp parallel for schedule(static, 512)
+		for (int i = 0; i < (int)J.rows(); i++)
+			for (SparseMatrix<double, RowMajor>::InnerIterator it(J, i); it; ++it) {
+				const int c = colors[it.col()] - c0;
+				if (c >= 0 && c < nb)
+					it.valueRef() = stencil(R, 4 * c, i, invH);
+			}
+	}
+
+	return J;
+}
+
+bool Kitten::checkJacobian(ResidualFunc f, const MatrixXd& J, const VectorXd& x, const double tol, const double h) {
+	const int M = (int)J.rows();
+	const int N = (int)J.cols();
+	printf("\n\033[1mJacobian test %dx%d\033[0m\n\n", M, N);
+
+	MatrixXd numerical = nJacobian(f, x, M, h);
+
+	std::vector<JacobianEntry> entries(M * (size_t)N);
+	for (int j = 0; j < N; j++)
+		for (int i = 0; i < M; i++)
+			entries[i + j * (size_t)M] = { i, j, J(i, j), numerical(i, j), 0 };
+
+	return reportJacobian(M, N, 4 * N, entries, tol);
+}
+
+bool Kitten::checkJacobian(ResidualFunc f, const SparseMatrix<double, RowMajor>& J, const VectorXd& x,
+	const double tol, const double h, const SparseMatrix<double, RowMajor>* pattern) {
+	const int M = (int)J.rows();
+	const int N = (int)J.cols();
+	if (!pattern) pattern = &J;
+
+	std::vector<int> colors;
+	const int numColors = colorJacobian(*pattern, colors);
+	printf("\n\033[1mJacobian test %dx%d\033[0m (%d colors)\n\n", M, N, numColors);
+
+	SparseMatrix<double, RowMajor> numerical = nJacobian(f, x, *pattern, h);
+
+	std::vector<JacobianEntry> entries;
+	entries.reserve(numerical.nonZeros());
+	for (int i = 0; i < M; i++)
+		for (SparseMatrix<double, RowMajor>::InnerIterator it(numerical, i); it; ++it)
+			entries.push_back({ i, (int)it.col(), J.coeff(i, it.col()), it.value(), 0 });
+
+	return reportJacobian(M, N, 4 * numColors, entries, tol);
+}
+
+bool Kitten::checkGradient(std::function<double(const VectorXd&)> f, const VectorXd& grad, const VectorXd& x,
+	const int K, const double tol, const double h, const int levels, double* maxErrOut) {
+	const int n = (int)x.size();
+	const int L = std::max(levels, 1);
+	const double secondaryTol = pow2(tol);
+	printf("\n\033[1mGradient test N=%d\033[0m (%d directions, %d step sizes)\n\n", n, K, L);
+
+	// Seeded per direction so results are reproducible regardless of thread count
+	std::vector<VectorXd> dirs(K);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int k = 0; k < K; k++) {
+		std::mt19937 rng(k);
+		std::normal_distribution<double> dist;
+		dirs[k].resize(n);
+		for (int i = 0; i < n; i++)
+			dirs[k][i] = dist(rng);
+		dirs[k].normalize();
+	}
+
+	// Evaluate f(x +- h_l v_k) for every direction and step size
+	std::vector<double> evals(2 * K * L);
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int t = 0; t < 2 * K * L; t++) {
+		const int k = t / (2 * L);
+		const int l = (t / 2) % L;
+		const double s = (t % 2 ? -1 : 1) * h / (1 << l);
+		evals[t] = f(x + s * dirs[k]);
+	}
+
+	std::vector<double> given(K), numerical(K), noise(K), err(K);
+	double maxErr = 0;
+	bool good = true;
+	bool flipped = false;
+
+	for (int k = 0; k < K; k++) {
+		given[k] = grad.dot(dirs[k]);
+
+		// Richardson extrapolation of the O(h^2) central differences
+		std::vector<double> R(L);
+		for (int l = 0; l < L; l++) {
+			const int t = 2 * (k * L + l);
+			R[l] = (evals[t] - evals[t + 1]) * (1 << l) / (2 * h);
+		}
+		double prev = R[L - 1];
+		for (int m = 1; m < L; m++) {
+			const double scale = 1. / ((1 << (2 * m)) - 1);
+			prev = R[L - 1];
+			for (int l = L - 1; l >= m; l--)
+				R[l] += (R[l] - R[l - 1]) * scale;
+		}
+		numerical[k] = R[L - 1];
+		noise[k] = abs(R[L - 1] - prev);
+
+		err[k] = relError(given[k], numerical[k]);
+		if (err[k] > tol) {
+			good = false;
+			if (relError(-given[k], numerical[k]) <= tol) flipped = true;
+		}
+		maxErr = glm::max(maxErr, err[k]);
+	}
+
+	printf("dir: grad . v      numerical   relative err  (extrapolation change)\n");
+	for (int k = 0; k < K; k++) {
+		printf("%3d: ", k);
+		if (err[k] > tol) printf("\033[31m");
+		else if (err[k] > secondaryTol) printf("\033[33m");
+		if (err[k] == maxErr) printf("\033[1m");
+		printf("%10f \033[0m", given[k]);
+
+		if (err[k] > tol) printf("\033[32m");
+		if (err[k] == maxErr) printf("\033[1m");
+		printf("%10f \033[0m", numerical[k]);
+
+		if (err[k] > tol) printf("\033[31m");
+		else if (err[k] > secondaryTol) printf("\033[33m");
+		if (err[k] == maxErr) printf("\033[1m");
+		if (err[k] == 0) printf("%13d \033[0m", 0);
+		else printf("%13.2e \033[0m", err[k]);
+
+		// A large change means the finite differences themselves are not converged
+		if (noise[k] > tol * glm::max(abs(numerical[k]), 1.)) printf("\033[33m");
+		printf(" (%.1e)\033[0m\n", noise[k]);
+	}
+	printf("\n");
+
+	printf("Checked %d directions with %d evaluations\n", K, 2 * K * L);
+	printf("Max error: ");
+	if (maxErr > tol) printf("\033[1;31m");
+	else if (maxErr > secondaryTol) printf("\033[1;33m");
+	printf("%10.3e \033[0m\n", maxErr);
+
+	if (flipped) printf("\033[1;31mFlipped sign??\033[0m\n");
+
+	if (good)
+		printf("\n\033[1;32mAll pass!\033[0m\n");
+	else
+		printf("\n\033[1;31m=====    SOMETHING IS WRONG!!!!!!!!!!!    =====\033[0m\n");
+	printf("End gradient test.\n");
+
+	if (maxErrOut) *maxErrOut = maxErr;
+	return good;
+}
@@ -0,0 +1,107 @@
+#include "../includes/modules/Algo.h"
+
+using namespace Eigen;
+
+Eigen::VectorXd Kitten::lmMin(
+	std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> r,
+	std::function<Eigen::SparseMatrix<double, Eigen::RowMajor>(const Eigen::VectorXd&)> J,
+	const Eigen::VectorXd& guess,
+	const LMParams& params,
+	LMStats* stats) {
+
+	LMStats st;
+	const int cgLim = params.cgItrLim < 0 ? std::max(100, 2 * (int)guess.size()) : params.cgItrLim;
+
+	VectorXd x = guess, xn;
+	VectorXd res, resn;
+	r(x, res);
+	st.numREvals++;
+	double cost = 0.5 * res.squaredNorm();
+
+	SparseMatrix<double, RowMajor> Jm;
+	VectorXd g, colSq, invDiag, b, d, Jd, tmp;
+	double mu = 0, nu = 2;
+	bool newJ = true;
+
+	for (; st.itr < params.itrLim; st.itr++) {
+		if (newJ) {
+			Jm = J(x);
+			st.numJEvals++;
+			g = Jm.transpose() * res;
+
+			// diag(J^T J) for the preconditioner
+			colSq = Jm.cwiseAbs2().transpose() * VectorXd::Ones(Jm.rows());
+
+			st.gradNorm = g.lpNorm<Infinity>();
+			if (st.gradNorm < params.tol) {
+				st.converged = true;
+				break;
+			}
+
+			if (st.itr == 0) mu = params.damping * std::max(colSq.maxCoeff(), 1e-12);
+			newJ = false;
+		}
+
+		// Solve (J^T J + mu I) d = -g without assembling J^T J
+		invDiag = (colSq.array() + mu).inverse();
+		b = -g;
+		int cgItr = 0;
+		d = cg([&](const VectorXd& v, VectorXd& Av) {
+			tmp = Jm * v;
+			Av = Jm.transpose() * tmp + mu * v;
+			}, invDiag, b, params.cgTol, cgLim, &cgItr);
+		st.cgItr += cgItr;
+
+		if (d.norm() <= params.stepTol * (x.norm() + params.stepTol)) {
+			st.converged = true;
+			break;
+		}
+
+		// Reduction predicted by the linearized model. Exact CG would give 0.5 d^T (mu d - g).
+		Jd = Jm * d;
+		const double pred = -(g.dot(d) + 0.5 * Jd.squaredNorm());
+
+		xn = x + d;
+		r(xn, resn);
+		st.numREvals++;
+		const double costn = 0.5 * resn.squaredNorm();
+		const double rho = (cost - costn) / pred;
+
+		if (params.verbose)
+			printf("lm %d: cost=%.6e |g|=%.3e mu=%.2e cg=%d rho=%.3f\n", st.itr, costn, st.gradNorm, mu, cgItr, rho);
+
+		if (pred > 0 && rho > 0) {
+			// Accept and relax the damping towards Gauss-Newton
+			x.swap(xn);
+			res.swap(resn);
+			cost = costn;
+			mu *= std::max(1 / 3., 1 - pow(2 * rho - 1, 3));
+			nu = 2;
+			newJ = true;
+			st.costs.push_back(cost);
+		}
+		else {
+			// Reject and move towards gradient descent
+			mu *= nu;
+			nu *= 2;
+			st.numRejected++;
+		}
+	}
+
+	st.cost = cost;
+	st.damping = mu;
+	if (stats) *stats = st;
+	return x;
+}
+
+Eigen::VectorXd Kitten::lmMin(
+	std::function<void(const Eigen::VectorXd&, Eigen::VectorXd&)> r,
+	const Eigen::SparseMatrix<double, Eigen::RowMajor>& pattern,
+	const Eigen::VectorXd& guess,
+	const LMParams& params,
+	LMStats* stats) {
+
+	return lmMin(r, [&](const VectorXd& x) {
+		return nJacobian(r, x, pattern, params.h);
+		}, guess, params, stats);
+}
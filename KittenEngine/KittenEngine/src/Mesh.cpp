@@ -3,6 +3,7 @@
 #include "../includes/modules/KittenAssets.h"
 #include "../includes/modules/KittenRendering.h"
 #include "../includes/modules/KittenPreprocessor.h"
+#include "../includes/modules/RotorBatch.h"
 #include <glad/glad.h> 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -103,6 +104,13 @@ namespace Kitten {
 		}
 	}
 
+	void Mesh::transform(Rotor q, vec3 translation) {
+		if (vertices.empty()) return;
+		constexpr size_t stride = sizeof(Vertex) / sizeof(float);
+		rigidTransform(q, translation, &vertices[0].pos.x, stride, (int)vertices.size());
+		rigidTransform(q, vec3(0), &vertices[0].norm.x, stride, (int)vertices.size());
+	}
+
 	void Mesh::upload() {
 		initGL();
 		glBindVertexArray(VAO);
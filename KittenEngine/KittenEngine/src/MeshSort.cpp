@@ -0,0 +1,91 @@
+#include "../includes/modules/Mesh.h"
+#include "../includes/modules/SpatialSort.h"
+#include <numeric>
+
+namespace Kitten {
+	// Sorts the elements of size K in idx[begin, end) by the keys of their centroids
+	template<int K>
+	static void sortElements(vector<unsigned int>& idx, size_t begin, size_t end,
+		const vector<Vertex>& verts, const Bound<>& bounds, SpatialKey type) {
+		const size_t n = (end - begin) / K;
+		if (n < 2) return;
+
+		vector<vec3> centers(n);
+#pragma omp parallel for schedule(static, 4096)
+		for (long long i = 0; i < (long long)n; i++) {
+			vec3 c(0);
+			for (int k = 0; k < K; k++)
+				c += verts[idx[begin + K * i + k]].pos;
+			centers[i] = c * (1.f / K);
+		}
+
+		vector<uint64_t> keys(n);
+		vector<uint32_t> perm(n);
+		std::iota(perm.begin(), perm.end(), 0u);
+		spatialKeys(centers.data(), keys.data(), n, bounds, type);
+		radixSort(keys.data(), perm.data(), n, 63);
+
+		vector<unsigned int> sorted(K * n);
+#pragma omp parallel for schedule(static, 4096)
+		for (long long i = 0; i < (long long)n; i++)
+			for (int k = 0; k < K; k++)
+				sorted[K * i + k] = idx[begin + K * perm[i] + k];
+		std::copy(sorted.begin(), sorted.end(), idx.begin() + begin);
+	}
+
+	// Sorts vertices, then triangles within each group, then tets if given
+	static void spatialSortMesh(Mesh& mesh, vector<unsigned int>* tets, SpatialKey type) {
+		const size_t numVerts = mesh.vertices.size();
+		Bound<> bounds;
+		for (const Vertex& v : mesh.vertices)
+			bounds.absorb(v.pos);
+
+		// Vertices
+		vector<vec3> pos(numVerts);
+		for (size_t i = 0; i < numVerts; i++)
+			pos[i] = mesh.vertices[i].pos;
+		vector<uint64_t> keys(numVerts);
+		vector<uint32_t> perm(numVerts);
+		std::iota(perm.begin(), perm.end(), 0u);
+		spatialKeys(pos.data(), keys.data(), numVerts, bounds, type);
+		radixSort(keys.data(), perm.data(), numVerts, 63);
+
+		vector<Vertex> sorted(numVerts);
+		vector<unsigned int> remap(numVerts);
+#pragma omp parallel for schedule(static, 4096)
+		for (long long i = 0; i < (long long)numVerts; i++) {
+			sorted[i] = mesh.vertices[perm[i]];
+			remap[perm[i]] = (unsigned int)i;
+		}
+		mesh.vertices.swap(sorted);
+
+		auto remapIndices = [&](vector<unsigned int>& idx) {
+#pragma omp parallel for schedule(static, 4096)
+			for (long long i = 0; i < (long long)idx.size(); i++)
+				idx[i] = remap[idx[i]];
+			};
+		remapIndices(mesh.indices);
+		if (tets) remapIndices(*tets);
+
+		// Triangles stay within their groups so the group offsets remain valid
+		vector<size_t> ends = mesh.groups;
+		ends.push_back(0);
+		ends.push_back(mesh.indices.size());
+		for (size_t& e : ends)
+			e = std::min(e, mesh.indices.size());
+		std::sort(ends.begin(), ends.end());
+		ends.erase(std::unique(ends.begin(), ends.end()), ends.end());
+		for (size_t g = 0; g + 1 < ends.size(); g++)
+			sortElements<3>(mesh.indices, ends[g], ends[g + 1], mesh.vertices, bounds, type);
+
+		if (tets) sortElements<4>(*tets, 0, tets->size(), mesh.vertices, bounds, type);
+	}
+
+	void Mesh::spatialSort(SpatialKey type) {
+		spatialSortMesh(*this, nullptr, type);
+	}
+
+	void TetMesh::spatialSort(SpatialKey type) {
+		spatialSortMesh(*this, &tetIndices, type);
+	}
+}
@@ -0,0 +1,292 @@
+#include "../includes/modules/RotorBatch.h"
+#include "../includes/modules/StopWatch.h"
+#include "../opt/lanes.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace Kitten {
+	// Runs kernel(const V in[NIn], V out[NOut]) over n elements of SoA arrays split into blocks across OpenMP threads.
+	// Output k of element i goes to out[k][i * outStride]. Partial and strided lanes are staged through a buffer.
+	template<typename V, int NIn, int NOut, typename K>
+	static void forEachLane(const float* const (&in)[NIn], float* const (&out)[NOut], int n, const K& kernel, const int outStride = 1) {
+		constexpr int W = V::width;
+		constexpr int blockSize = 1024;
+		const int numBlocks = (n + blockSize - 1) / blockSize;
+
+#pragma omp parallel for schedule(static, 1)
+		for (int b = 0; b < numBlocks; b++) {
+			const int end = std::min(n, (b + 1) * blockSize);
+			alignas(32) float buf[std::max(NIn, NOut)][W];
+			V vin[NIn], vout[NOut];
+
+			for (int i = b * blockSize; i < end; i += W) {
+				const int num = std::min(W, end - i);
+				if (num == W)
+					for (int k = 0; k < NIn; k++)
+						vin[k] = V::loadu(in[k] + i);
+				else {
+					// Lanes past end repeat the last element and are discarded
+					for (int k = 0; k < NIn; k++) {
+						for (int l = 0; l < W; l++)
+							buf[k][l] = in[k][i + std::min(l, num - 1)];
+						vin[k] = V::load(buf[k]);
+					}
+				}
+
+				kernel(vin, vout);
+
+				if (num == W && outStride == 1)
+					for (int k = 0; k < NOut; k++)
+						vout[k].storeu(out[k] + i);
+				else
+					for (int k = 0; k < NOut; k++) {
+						vout[k].store(buf[k]);
+						for (int l = 0; l < num; l++)
+							out[k][(size_t)(i + l) * outStride] = buf[k][l];
+					}
+			}
+		}
+	}
+
+	template<int NIn, int NOut, typename K>
+	static void forEach(RotorBatchWidth width, const float* const (&in)[NIn], float* const (&out)[NOut], int n, const K& kernel, const int outStride = 1) {
+#ifdef __AVX__
+		if (width != RotorBatchWidth::SSE) {
+			forEachLane<Lane8>(in, out, n, kernel, outStride);
+			return;
+		}
+#endif
+		forEachLane<Lane4>(in, out, n, kernel, outStride);
+	}
+
+	void rotate(const Rotor& q, Vec3SoA v, Vec3SoA out, int n, RotorBatchWidth width) {
+		// One rotor is cheapest applied as its matrix
+		const mat3 m = Rotor(q).matrix();
+		forEach(width, { v.x, v.y, v.z }, { out.x, out.y, out.z }, n, [&](const auto* a, auto* r) {
+			r[0] = m[0][0] * a[0] + m[1][0] * a[1] + m[2][0] * a[2];
+			r[1] = m[0][1] * a[0] + m[1][1] * a[1] + m[2][1] * a[2];
+			r[2] = m[0][2] * a[0] + m[1][2] * a[1] + m[2][2] * a[2];
+			});
+	}
+
+	void rotate(RotorSoA q, Vec3SoA v, Vec3SoA out, int n, RotorBatchWidth width) {
+		forEach(width, { q.x, q.y, q.z, q.w, v.x, v.y, v.z }, { out.x, out.y, out.z }, n, [](const auto* a, auto* r) {
+			const auto& x = a[0], & y = a[1], & z = a[2], & w = a[3];
+			const auto& vx = a[4], & vy = a[5], & vz = a[6];
+
+			// Same as Rotor::rotate(). a = w v + q x v and c = v . q
+			const auto ax = w * vx + (y * vz - z * vy);
+			const auto ay = w * vy + (z * vx - x * vz);
+			const auto az = w * vz + (x * vy - y * vx);
+			const auto c = vx * x + vy * y + vz * z;
+
+			r[0] = w * ax + (y * az - z * ay) + c * x;
+			r[1] = w * ay + (z * ax - x * az) + c * y;
+			r[2] = w * az + (x * ay - y * ax) + c * z;
+			});
+	}
+
+	// r = a * b for rotors as { x, y, z, w }
+	template<typename V>
+	static inline void composeLanes(const V* a, const V* b, V* r) {
+		r[0] = a[3] * b[0] + b[3] * a[0] + (a[1] * b[2] - a[2] * b[1]);
+		r[1] = a[3] * b[1] + b[3] * a[1] + (a[2] * b[0] - a[0] * b[2]);
+		r[2] = a[3] * b[2] + b[3] * a[2] + (a[0] * b[1] - a[1] * b[0]);
+		r[3] = a[3] * b[3] - (a[0] * b[0] + a[1] * b[1] + a[2] * b[2]);
+	}
+
+	template<typename V>
+	static inline void normalizeLanes(V* q) {
+		const V inv = 1.f / sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (int k = 0; k < 4; k++)
+			q[k] = q[k] * inv;
+	}
+
+	void compose(RotorSoA a, RotorSoA b, RotorSoA out, int n, RotorBatchWidth width) {
+		forEach(width, { a.x, a.y, a.z, a.w, b.x, b.y, b.z, b.w }, { out.x, out.y, out.z, out.w }, n, [](const auto* a, auto* r) {
+			composeLanes(a, a + 4, r);
+			});
+	}
+
+	void normalize(RotorSoA q, int n, RotorBatchWidth width) {
+		forEach(width, { q.x, q.y, q.z, q.w }, { q.x, q.y, q.z, q.w }, n, [](const auto* a, auto* r) {
+			for (int k = 0; k < 4; k++)
+				r[k] = a[k];
+			normalizeLanes(r);
+			});
+	}
+
+	void integrate(RotorSoA q, Vec3SoA omega, float dt, int n, RotorBatchWidth width) {
+		// exp(h) by scaling and squaring. h / 16 keeps the series accurate up to |omega dt| of about 6 radians.
+		constexpr int numSquarings = 4;
+		const float s = dt * 0.5f / (1 << numSquarings);
+		forEach(width, { q.x, q.y, q.z, q.w, omega.x, omega.y, omega.z }, { q.x, q.y, q.z, q.w }, n, [&](const auto* a, auto* r) {
+			typedef std::decay_t<decltype(*a)> V;
+			const V hx = a[4] * s, hy = a[5] * s, hz = a[6] * s;
+			const V t2 = hx * hx + hy * hy + hz * hz;
+
+			// sin(t) / t and cos(t) by their Taylor series
+			const V sinc = 1.f + t2 * (-1.f / 6 + t2 * (1.f / 120 + t2 * (-1.f / 5040)));
+			V e[4] = { hx * sinc, hy * sinc, hz * sinc,
+				1.f + t2 * (-0.5f + t2 * (1.f / 24 + t2 * (-1.f / 720 + t2 * (1.f / 40320)))) };
+
+			// e = e * e, which doubles the angle
+			for (int k = 0; k < numSquarings; k++) {
+				const V w = e[3] * e[3] - (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+				const V f = 2.f * e[3];
+				e[0] = e[0] * f;
+				e[1] = e[1] * f;
+				e[2] = e[2] * f;
+				e[3] = w;
+			}
+
+			composeLanes(e, a, r);
+			normalizeLanes(r);
+			});
+	}
+
+	void matrix(RotorSoA q, mat3* out, int n, RotorBatchWidth width) {
+		if (n <= 0) return;
+		float* m = &out[0][0][0];
+		forEach(width, { q.x, q.y, q.z, q.w }, { m, m + 1, m + 2, m + 3, m + 4, m + 5, m + 6, m + 7, m + 8 }, n, [](const auto* a, auto* r) {
+			// Same as Rotor::matrix(), 2 q q^T + (w^2 - |q|^2) I + 2 w crossMatrix(q), stored column major
+			const auto& x = a[0], & y = a[1], & z = a[2], & w = a[3];
+			const auto d = w * w - (x * x + y * y + z * z);
+			const auto xy = 2.f * x * y, xz = 2.f * x * z, yz = 2.f * y * z;
+			const auto wx = 2.f * w * x, wy = 2.f * w * y, wz = 2.f * w * z;
+			r[0] = 2.f * x * x + d;
+			r[1] = xy + wz;
+			r[2] = xz - wy;
+			r[3] = xy - wz;
+			r[4] = 2.f * y * y + d;
+			r[5] = yz + wx;
+			r[6] = xz + wy;
+			r[7] = yz - wx;
+			r[8] = 2.f * z * z + d;
+			}, 9);
+	}
+
+	void rigidTransform(const Rotor& q, const vec3& t, float* v, size_t stride, int n) {
+		const mat3 m = Rotor(q).matrix();
+#pragma omp parallel for schedule(static, 4096)
+		for (int i = 0; i < n; i++) {
+			float* p = v + i * stride;
+			const vec3 r = m * vec3(p[0], p[1], p[2]) + t;
+			p[0] = r.x;
+			p[1] = r.y;
+			p[2] = r.z;
+		}
+	}
+
+	void rotorBatchBenchmark(int n) {
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dist(-1, 1);
+
+		std::vector<Rotor> qa(n), qb(n), qr(n);
+		std::vector<vec3> va(n), vr(n), omega(n);
+		std::vector<mat3> mr(n), mb(n);
+		std::vector<float> soa(14 * (size_t)n);
+		float* p[14];
+		for (int k = 0; k < 14; k++)
+			p[k] = soa.data() + (size_t)k * n;
+		const RotorSoA a{ p[0], p[1], p[2], p[3] }, b{ p[4], p[5], p[6], p[7] }, r{ p[8], p[9], p[10], p[11] };
+		const Vec3SoA v{ p[4], p[5], p[6] }, vo{ p[8], p[9], p[10] }, w{ p[11], p[12], p[13] };
+		const float dt = 0.01f;
+
+		auto reset = [&]() {
+			for (int i = 0; i < n; i++) {
+				for (int k = 0; k < 4; k++) {
+					p[k][i] = qa[i][k];
+					p[4 + k][i] = qb[i][k];
+				}
+				for (int k = 0; k < 3; k++)
+					p[11 + k][i] = omega[i][k];
+			}
+			};
+
+		for (int i = 0; i < n; i++) {
+			qa[i] = normalize(Rotor(dist(rng), dist(rng), dist(rng), dist(rng)));
+			qb[i] = normalize(Rotor(dist(rng), dist(rng), dist(rng), dist(rng)));
+			va[i] = vec3(qb[i].x, qb[i].y, qb[i].z);
+			omega[i] = 50.f * vec3(dist(rng), dist(rng), dist(rng));
+		}
+
+		printf("rotor batch benchmark: n = %d\n", n);
+		StopWatch timer;
+		timer.gpuSync = false;
+		auto report = [&](const char* name, float err) {
+			printf("%-10s %8.3f ms  err %g\n", name, 1000 * timer.deltaTimes.back(), err);
+			};
+
+		// Each op runs scalar first, then the kernels are checked against the scalar result
+		auto vecError = [&]() {
+			float err = 0;
+			for (int i = 0; i < n; i++)
+				err = std::max(err, length(vec3(vo.x[i], vo.y[i], vo.z[i]) - vr[i]));
+			return err;
+			};
+		auto rotorError = [&]() {
+			float err = 0;
+			for (int i = 0; i < n; i++)
+				err = std::max(err, length(vec4(r.x[i], r.y[i], r.z[i], r.w[i]) - qr[i].v));
+			return err;
+			};
+
+		for (int op = 0; op < 6; op++) {
+			static const char* names[] = { "rotate1", "rotate", "compose", "normalize", "integrate", "matrix" };
+			printf("%s\n", names[op]);
+
+			timer.reset();
+			switch (op) {
+			case 0: for (int i = 0; i < n; i++) vr[i] = qa[0] * va[i]; break;
+			case 1: for (int i = 0; i < n; i++) vr[i] = qa[i] * va[i]; break;
+			case 2: for (int i = 0; i < n; i++) qr[i] = qa[i] * qb[i]; break;
+			case 3: for (int i = 0; i < n; i++) qr[i] = normalize(Rotor(2.f * qa[i].v)); break;
+			case 4:
+				for (int i = 0; i < n; i++) {
+					const float l = length(omega[i]);
+					qr[i] = normalize(Rotor::angleAxis(l * dt, l > 0 ? omega[i] / l : vec3(1, 0, 0)) * qa[i]);
+				}
+				break;
+			case 5: for (int i = 0; i < n; i++) mr[i] = qa[i].matrix(); break;
+			}
+			timer.time();
+			report("scalar", 0);
+
+			for (RotorBatchWidth width : { RotorBatchWidth::SSE, RotorBatchWidth::AVX }) {
+				reset();
+				if (op == 3)
+					for (int i = 0; i < n; i++)
+						for (int k = 0; k < 4; k++)
+							p[8 + k][i] = 2.f * qa[i][k];
+				timer.reset();
+				float err = 0;
+				switch (op) {
+				case 0: rotate(qa[0], v, vo, n, width); break;
+				case 1: rotate(a, v, vo, n, width); break;
+				case 2: compose(a, b, r, n, width); break;
+				case 3: normalize(r, n, width); break;
+				case 4: integrate(a, w, dt, n, width); break;
+				case 5: matrix(a, mb.data(), n, width); break;
+				}
+				timer.time();
+
+				if (op < 2) err = vecError();
+				else if (op < 4) err = rotorError();
+				else if (op == 4) {
+					// Compare up to sign since both represent the same rotation
+					for (int i = 0; i < n; i++) {
+						const vec4 q(a.x[i], a.y[i], a.z[i], a.w[i]);
+						err = std::max(err, std::min(length(q - qr[i].v), length(q + qr[i].v)));
+					}
+				}
+				else
+					for (int i = 0; i < n; i++)
+						for (int c = 0; c < 3; c++)
+							err = std::max(err, length(mb[i][c] - mr[i][c]));
+				report(width == RotorBatchWidth::SSE ? "sse" : "avx", err);
+			}
+		}
+	}
+}
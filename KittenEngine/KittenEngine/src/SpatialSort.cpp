@@ -0,0 +1,231 @@
+#include "../includes/modules/SpatialSort.h"
+#include "../includes/modules/StopWatch.h"
+#include <immintrin.h>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+// MSVC has no __BMI2__ but every AVX2 target it builds for has BMI2
+#if defined(__BMI2__) || (defined(_MSC_VER) && defined(__AVX2__))
+#define KITTEN_HAS_PDEP
+#endif
+
+namespace Kitten {
+	static inline uint64_t morton64(const ivec3 cell) {
+#ifdef KITTEN_HAS_PDEP
+		return _pdep_u64((uint32_t)cell.x, 0x4924924924924924ull)
+			| _pdep_u64((uint32_t)cell.y, 0x2492492492492492ull)
+			| _pdep_u64((uint32_t)cell.z, 0x1249249249249249ull);
+#else
+		return getMorton64(cell);
+#endif
+	}
+
+#ifdef __AVX2__
+	// mortonExpandBits64() on 4 lanes
+	static inline __m256i expandBits(__m256i v) {
+		v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 32)), _mm256_set1_epi64x(0x001f00000000ffffll));
+		v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 16)), _mm256_set1_epi64x(0x001f0000ff0000ffll));
+		v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 8)), _mm256_set1_epi64x(0x100f00f00f00f00fll));
+		v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 4)), _mm256_set1_epi64x(0x10c30c30c30c30c3ll));
+		v = _mm256_and_si256(_mm256_or_si256(v, _mm256_slli_epi64(v, 2)), _mm256_set1_epi64x(0x1249249249249249ll));
+		return v;
+	}
+
+	// Interleaves 8 lanes of 21 bit coordinates into 8 keys
+	static inline void interleave8(const __m256i x[3], uint64_t* keys) {
+		for (int h = 0; h < 2; h++) {
+			__m256i k = _mm256_setzero_si256();
+			for (int a = 0; a < 3; a++) {
+				const __m128i half = h ? _mm256_extracti128_si256(x[a], 1) : _mm256_castsi256_si128(x[a]);
+				k = _mm256_or_si256(k, _mm256_slli_epi64(expandBits(_mm256_cvtepu32_epi64(half)), 2 - a));
+			}
+			_mm256_storeu_si256((__m256i*)(keys + 4 * h), k);
+		}
+	}
+
+	// getHilbert64() on 8 lanes
+	static inline void hilbert8(__m256i x[3], uint64_t* keys) {
+		const __m256i zero = _mm256_setzero_si256();
+		for (uint32_t q = 1u << 20; q > 1; q >>= 1) {
+			const __m256i qv = _mm256_set1_epi32(q), p = _mm256_set1_epi32(q - 1);
+			__m256i m = _mm256_cmpgt_epi32(_mm256_and_si256(x[0], qv), zero);
+			x[0] = _mm256_xor_si256(x[0], _mm256_and_si256(p, m));
+			for (int i = 1; i < 3; i++) {
+				m = _mm256_cmpgt_epi32(_mm256_and_si256(x[i], qv), zero);
+				const __m256i t = _mm256_andnot_si256(m, _mm256_and_si256(_mm256_xor_si256(x[0], x[i]), p));
+				x[0] = _mm256_xor_si256(x[0], _mm256_or_si256(_mm256_and_si256(p, m), t));
+				x[i] = _mm256_xor_si256(x[i], t);
+			}
+		}
+
+		x[1] = _mm256_xor_si256(x[1], x[0]);
+		x[2] = _mm256_xor_si256(x[2], x[1]);
+		__m256i t = zero;
+		for (uint32_t q = 1u << 20; q > 1; q >>= 1) {
+			const __m256i m = _mm256_cmpgt_epi32(_mm256_and_si256(x[2], _mm256_set1_epi32(q)), zero);
+			t = _mm256_xor_si256(t, _mm256_and_si256(_mm256_set1_epi32(q - 1), m));
+		}
+		for (int i = 0; i < 3; i++)
+			x[i] = _mm256_xor_si256(x[i], t);
+		interleave8(x, keys);
+	}
+#endif
+
+	void spatialKeys(const vec3* pos, uint64_t* keys, size_t n, const Bound<>& bounds, SpatialKey type) {
+		constexpr long long blockSize = 4096;
+		const long long numBlocks = ((long long)n + blockSize - 1) / blockSize;
+
+#pragma omp parallel for schedule(static, 1)
+		for (long long b = 0; b < numBlocks; b++) {
+			const size_t end = std::min(n, (size_t)((b + 1) * blockSize));
+			size_t i = b * blockSize;
+
+#ifdef __AVX2__
+			// Points are AoS so cells are staged through a small buffer
+			alignas(32) int cells[3][8];
+			for (; i + 8 <= end; i += 8) {
+				for (int l = 0; l < 8; l++) {
+					const ivec3 c = spatialKeyCell(pos[i + l], bounds);
+					cells[0][l] = c.x;
+					cells[1][l] = c.y;
+					cells[2][l] = c.z;
+				}
+				__m256i x[3];
+				for (int a = 0; a < 3; a++)
+					x[a] = _mm256_load_si256((const __m256i*)cells[a]);
+				if (type == SpatialKey::Hilbert) hilbert8(x, keys + i);
+				else interleave8(x, keys + i);
+			}
+#endif
+
+			for (; i < end; i++) {
+				const ivec3 c = spatialKeyCell(pos[i], bounds);
+				keys[i] = type == SpatialKey::Hilbert ? getHilbert64(c) : morton64(c);
+			}
+		}
+	}
+
+	void radixSort(uint64_t* keys, uint32_t* values, size_t n, int keyBits) {
+		// 11 bit digits take 6 passes for 64 bit keys and 2 for 21 bit cell keys
+		constexpr int RADIX_BITS = 11;
+		constexpr int RADIX = 1 << RADIX_BITS;
+		if (n < 2) return;
+
+		// Fixed chunks keep the result independent of the thread count
+		const int numChunks = (int)std::min<size_t>(64, (n + 16383) / 16384);
+		const size_t chunkSize = (n + numChunks - 1) / numChunks;
+		std::vector<size_t> hist((size_t)numChunks * RADIX);
+		std::vector<uint64_t> tmpKeys(n);
+		std::vector<uint32_t> tmpValues(n);
+
+		uint64_t* srcK = keys, * dstK = tmpKeys.data();
+		uint32_t* srcV = values, * dstV = tmpValues.data();
+		for (int shift = 0; shift < keyBits; shift += RADIX_BITS) {
+#pragma omp parallel for schedule(static, 1)
+			for (int c = 0; c < numChunks; c++) {
+				size_t* h = hist.data() + (size_t)c * RADIX;
+				std::fill(h, h + RADIX, 0);
+				const size_t end = std::min(n, (c + 1) * chunkSize);
+				for (size_t i = c * chunkSize; i < end; i++)
+					h[(srcK[i] >> shift) & (RADIX - 1)]++;
+			}
+
+			// Exclusive scan in digit then chunk order. Skip the pass if every key shares the digit.
+			size_t sum = 0;
+			bool trivial = false;
+			for (int d = 0; d < RADIX; d++) {
+				const size_t start = sum;
+				for (int c = 0; c < numChunks; c++) {
+					size_t& h = hist[(size_t)c * RADIX + d];
+					const size_t count = h;
+					h = sum;
+					sum += count;
+				}
+				trivial = trivial || sum - start == n;
+			}
+			if (trivial) continue;
+
+#pragma omp parallel for schedule(static, 1)
+			for (int c = 0; c < numChunks; c++) {
+				size_t* h = hist.data() + (size_t)c * RADIX;
+				const size_t end = std::min(n, (c + 1) * chunkSize);
+				for (size_t i = c * chunkSize; i < end; i++) {
+					const size_t j = h[(srcK[i] >> shift) & (RADIX - 1)]++;
+					dstK[j] = srcK[i];
+					dstV[j] = srcV[i];
+				}
+			}
+			std::swap(srcK, dstK);
+			std::swap(srcV, dstV);
+		}
+
+		if (srcK != keys) {
+			std::copy(srcK, srcK + n, keys);
+			std::copy(srcV, srcV + n, values);
+		}
+	}
+
+	std::vector<uint32_t> spatialOrder(const std::vector<vec3>& pos, SpatialKey type) {
+		Bound<> bounds;
+		for (const vec3& p : pos)
+			bounds.absorb(p);
+
+		std::vector<uint64_t> keys(pos.size());
+		std::vector<uint32_t> perm(pos.size());
+		std::iota(perm.begin(), perm.end(), 0u);
+		spatialKeys(pos.data(), keys.data(), pos.size(), bounds, type);
+		radixSort(keys.data(), perm.data(), pos.size(), 63);
+		return perm;
+	}
+
+	void spatialSortBenchmark(int n) {
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> dist(-1, 1);
+		std::vector<vec3> pos(n);
+		for (int i = 0; i < n; i++)
+			pos[i] = vec3(dist(rng), dist(rng), dist(rng));
+		const Bound<> bounds(vec3(-1), vec3(1));
+
+		printf("spatial sort benchmark: n = %d\n", n);
+		StopWatch timer;
+		timer.gpuSync = false;
+
+		std::vector<uint64_t> ref(n), keys(n);
+		for (SpatialKey type : { SpatialKey::Morton, SpatialKey::Hilbert }) {
+			const char* name = type == SpatialKey::Morton ? "morton" : "hilbert";
+
+			timer.reset();
+			for (int i = 0; i < n; i++) {
+				const ivec3 c = spatialKeyCell(pos[i], bounds);
+				ref[i] = type == SpatialKey::Morton ? getMorton64(c) : getHilbert64(c);
+			}
+			timer.time();
+			printf("%-8s scalar   %8.3f ms\n", name, 1000 * timer.deltaTimes.back());
+
+			timer.reset();
+			spatialKeys(pos.data(), keys.data(), n, bounds, type);
+			timer.time();
+			printf("%-8s batched  %8.3f ms  %s\n", name, 1000 * timer.deltaTimes.back(), keys == ref ? "match" : "MISMATCH");
+		}
+
+		std::vector<uint32_t> values(n);
+		std::iota(values.begin(), values.end(), 0u);
+		std::vector<std::pair<uint64_t, uint32_t>> pairs(n);
+		for (int i = 0; i < n; i++)
+			pairs[i] = { keys[i], (uint32_t)i };
+
+		timer.reset();
+		std::sort(pairs.begin(), pairs.end());
+		timer.time();
+		printf("std::sort         %8.3f ms\n", 1000 * timer.deltaTimes.back());
+
+		timer.reset();
+		radixSort(keys.data(), values.data(), n, 63);
+		timer.time();
+		bool match = true;
+		for (int i = 0; i < n; i++)
+			match = match && pairs[i].first == keys[i] && pairs[i].second == values[i];
+		printf("radixSort         %8.3f ms  %s\n", 1000 * timer.deltaTimes.back(), match ? "match" : "MISMATCH");
+	}
+}